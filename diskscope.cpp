@@ -7,9 +7,52 @@
 #include <iomanip>
 #include <cstdint>
 #include <future>
+#include <fstream>
+#include <string_view>
+#include <ctime>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <array>
+#include <map>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <condition_variable>
+#include <type_traits>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+#include <charconv>
 
 #ifdef _WIN32
 #include <windows.h>
+#include <conio.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/quota.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#ifndef PRJQUOTA
+#define PRJQUOTA 2
+#endif
 #endif
 
 namespace fs = std::filesystem;
@@ -48,155 +91,6387 @@ void clearScreen() {
 #endif
 }
 
+/**
+ * Appends s as a quoted JSON string. '<' is escaped too so the
+ * result is safe inside a <script> block.
+ */
+void appendJsonString(std::string& out, std::string_view s) {
+    static const char* hex = "0123456789abcdef";
+    out += '"';
+    for (char ch : s) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += ch;
+        } else if (c < 0x20 || c == '<') {
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        } else {
+            out += ch;
+        }
+    }
+    out += '"';
+}
+
+std::string lowerCase(std::string_view s) {
+    std::string out(s);
+    for (auto& c : out) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+bool endsWith(std::string_view s, std::string_view suffix) {
+    return s.size() >= suffix.size() && s.substr(s.size() - suffix.size()) == suffix;
+}
+
 // ============================================================================
-// SIZE CALCULATION
+// SCAN TRACING (Chrome trace-event / Perfetto)
 // ============================================================================
 
-std::uintmax_t calculateFolderSize(const fs::path& folderPath) {
-    std::uintmax_t totalSize = 0;
-    std::error_code ec;
-    
-    // Try to iterate the directory
-    auto dirIter = fs::directory_iterator(folderPath, ec);
-    if (ec) {
-        // Access denied or other error - return 0
-        return 0;
+enum TraceKind : std::uint8_t {
+    TRACE_TASK,     // one parallel scan task, start to finish
+    TRACE_OPEN,     // opening a directory
+    TRACE_LIST,     // reading a directory's entries
+    TRACE_STAT,     // a single slow stat
+    TRACE_PENDING   // counter: scan tasks queued or running
+};
+
+/**
+ * One fixed-size event. Only the tail of the path is kept so recording
+ * never allocates.
+ */
+struct TraceEvent {
+    std::uint64_t start;      // ns since the trace started
+    std::uint64_t value;      // duration in ns, or the counter value
+    TraceKind kind;
+    char name[47];
+};
+
+// Events per thread; older ones are overwritten
+const std::size_t TRACE_RING_SIZE = 1 << 14;
+// Individual stats are only recorded when slower than this
+const std::uint64_t TRACE_SLOW_STAT_NS = 1000000;
+
+/**
+ * Ring buffer owned by one thread. Only that thread writes; `head` is
+ * published with release so a reader never sees half-written events.
+ */
+struct TraceBuffer {
+    std::uint32_t threadIndex = 0;
+    std::vector<TraceEvent> events = std::vector<TraceEvent>(TRACE_RING_SIZE);
+    std::atomic<std::uint64_t> head{0};
+};
+
+bool traceEnabled = false;
+const auto traceEpoch = std::chrono::steady_clock::now();
+std::atomic<int> tracePendingTasks{0};
+std::mutex traceRegistryMutex;
+std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+thread_local TraceBuffer* threadTrace = nullptr;
+
+std::uint64_t traceNow() {
+    if (!traceEnabled) return 0;
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - traceEpoch).count());
+}
+
+void traceRecord(TraceKind kind, std::uint64_t start, std::uint64_t value, const fs::path* path) {
+    if (!threadTrace) {
+        // First event on this thread - the only time a lock is taken
+        std::lock_guard<std::mutex> lock(traceRegistryMutex);
+        traceBuffers.push_back(std::make_unique<TraceBuffer>());
+        threadTrace = traceBuffers.back().get();
+        threadTrace->threadIndex = static_cast<std::uint32_t>(traceBuffers.size());
     }
-    
-    for (const auto& entry : dirIter) {
-        std::error_code entryEc;
-        
-        // Skip symbolic links
-        if (entry.is_symlink(entryEc)) {
-            continue;
-        }
-        
-        if (entry.is_directory(entryEc) && !entryEc) {
-            // Recurse into subdirectory
-            totalSize += calculateFolderSize(entry.path());
+
+    std::uint64_t h = threadTrace->head.load(std::memory_order_relaxed);
+    TraceEvent& e = threadTrace->events[h & (TRACE_RING_SIZE - 1)];
+    e.start = start;
+    e.value = value;
+    e.kind = kind;
+    e.name[0] = '\0';
+    if (path) {
+        const auto& native = path->native();
+        std::size_t keep = std::min(native.size(), sizeof(e.name) - 1);
+        for (std::size_t i = 0; i < keep; ++i) {
+            // Anything but printable ASCII (wide chars on Windows) becomes '?'
+            auto c = native[native.size() - keep + i];
+            e.name[i] = (c >= 0x20 && c <= 0x7E) ? static_cast<char>(c) : '?';
         }
-        else if (entry.is_regular_file(entryEc) && !entryEc) {
-            // Add file size
-            auto fileSize = entry.file_size(entryEc);
-            if (!entryEc) {
-                totalSize += fileSize;
+        e.name[keep] = '\0';
+    }
+    threadTrace->head.store(h + 1, std::memory_order_release);
+}
+
+/**
+ * Ends a span that started at `start` (from traceNow()). Stats are
+ * dropped unless slow, so tracing stays cheap enough to leave on.
+ */
+void traceSpan(TraceKind kind, std::uint64_t start, const fs::path& path) {
+    if (!traceEnabled) return;
+    std::uint64_t duration = traceNow() - start;
+    if (kind == TRACE_STAT && duration < TRACE_SLOW_STAT_NS) return;
+    traceRecord(kind, start, duration, &path);
+}
+
+void traceTaskQueued() {
+    if (!traceEnabled) return;
+    traceRecord(TRACE_PENDING, traceNow(), ++tracePendingTasks, nullptr);
+}
+
+void traceTaskDone(std::uint64_t start, const fs::path& path) {
+    if (!traceEnabled) return;
+    traceSpan(TRACE_TASK, start, path);
+    traceRecord(TRACE_PENDING, traceNow(), --tracePendingTasks, nullptr);
+}
+
+/**
+ * Dumps every thread's ring as Chrome trace-event JSON. Open the
+ * file in ui.perfetto.dev or chrome://tracing.
+ */
+bool writeTraceFile(const fs::path& outFile) {
+    static const char* kindNames[] = {"task", "open", "list", "stat", "pending tasks"};
+    std::ofstream out(outFile, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error: Cannot create " << outFile << "\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(traceRegistryMutex);
+    std::uint64_t dropped = 0;
+    std::string json = "{\"traceEvents\":[\n";
+    json += "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"DiskScope\"}}";
+
+    for (const auto& buf : traceBuffers) {
+        std::string tid = std::to_string(buf->threadIndex);
+        json += ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" + tid +
+                ",\"args\":{\"name\":\"worker " + tid + "\"}}";
+
+        std::uint64_t head = buf->head.load(std::memory_order_acquire);
+        std::uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        dropped += first;
+
+        for (std::uint64_t i = first; i < head; ++i) {
+            const TraceEvent& e = buf->events[i & (TRACE_RING_SIZE - 1)];
+            std::ostringstream ts;
+            ts << std::fixed << std::setprecision(3) << e.start / 1000.0;
+
+            json += ",\n{\"pid\":1,\"tid\":" + tid + ",\"ts\":" + ts.str() + ",\"name\":\"" + kindNames[e.kind] + "\"";
+            if (e.kind == TRACE_PENDING) {
+                json += ",\"ph\":\"C\",\"args\":{\"tasks\":" + std::to_string(e.value) + "}}";
+            } else {
+                std::ostringstream dur;
+                dur << std::fixed << std::setprecision(3) << e.value / 1000.0;
+                json += ",\"ph\":\"X\",\"cat\":\"scan\",\"dur\":" + dur.str() + ",\"args\":{\"path\":";
+                appendJsonString(json, e.name);
+                json += "}}";
             }
         }
     }
-    
-    return totalSize;
+    json += "\n],\"otherData\":{\"droppedEvents\":" + std::to_string(dropped) + "}}\n";
+
+    out << json;
+    if (!out) {
+        std::cerr << "Error: Cannot write " << outFile << "\n";
+        return false;
+    }
+    std::cout << "  Trace written to " << outFile.string() << "\n";
+    return true;
 }
 
 // ============================================================================
-// FOLDER INFO (for current level only)
+// FILESYSTEM BACKEND
 // ============================================================================
 
-struct FolderEntry {
-    std::string name;
+/**
+ * Metadata kept for each entry besides its name
+ */
+enum class EntryType : std::uint8_t { File, Folder, Other };
+
+struct EntryInfo {
+    EntryType type = EntryType::Other;  // as list() classifies it
+    std::uintmax_t size = 0;
+    std::uintmax_t alloc = 0;   // bytes actually allocated on disk
+    std::int64_t mtime = 0;     // seconds since the Unix epoch
+    std::uint32_t uid = 0;      // owner (always 0 on Windows)
+    std::uint64_t device = 0;   // st_dev (always 0 on Windows)
+    std::uint64_t inode = 0;    // st_ino (always 0 on Windows)
+};
+
+bool followSymlinks = false;    // --follow: treat symlinks as what they point to
+
+/**
+ * Reads size, allocation, mtime and owner of one entry, without following
+ * symlinks unless --follow is on. Returns false if the entry can't be read.
+ */
+bool readEntryInfo(const fs::path& path, EntryInfo& info) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    std::uint64_t ticks = (std::uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    if (!followSymlinks && (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) info.type = EntryType::Other;
+    else if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) info.type = EntryType::Folder;
+    else info.type = EntryType::File;
+    info.size = (std::uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    info.alloc = info.size;
+    info.mtime = std::int64_t(ticks / 10000000) - 11644473600LL;  // 1601 -> 1970
+    info.uid = 0;
+    info.device = 0;
+    info.inode = 0;
+#else
+    struct stat st;
+    if ((followSymlinks ? ::stat(path.c_str(), &st) : ::lstat(path.c_str(), &st)) != 0) {
+        return false;
+    }
+    info.type = S_ISDIR(st.st_mode) ? EntryType::Folder : S_ISREG(st.st_mode) ? EntryType::File : EntryType::Other;
+    info.size = static_cast<std::uintmax_t>(st.st_size);
+    info.alloc = static_cast<std::uintmax_t>(st.st_blocks) * 512;
+    info.mtime = static_cast<std::int64_t>(st.st_mtime);
+    info.uid = static_cast<std::uint32_t>(st.st_uid);
+    info.device = static_cast<std::uint64_t>(st.st_dev);
+    info.inode = static_cast<std::uint64_t>(st.st_ino);
+#endif
+    return true;
+}
+
+enum class FsResult { Ok, Error, TimedOut };
+
+/**
+ * Project quota settings of a folder (XFS / ext4 FS_IOC_FSGETXATTR)
+ */
+struct ProjectInfo {
+    std::uint32_t id = 0;       // 0 = none, or not supported
+    bool inherit = false;       // new entries below get the same id
+};
+
+/**
+ * Reads a folder's project id. Opening the folder is a filesystem call
+ * like any other (it blocks on a hung mount), so backends route it.
+ */
+FsResult readProjectInfo(const fs::path& folderPath, ProjectInfo& info) {
+#ifdef __linux__
+    int fd = open(folderPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return FsResult::Error;
+    struct fsxattr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    if (ioctl(fd, FS_IOC_FSGETXATTR, &attr) == 0) {
+        info.id = attr.fsx_projid;
+        info.inherit = (attr.fsx_xflags & FS_XFLAG_PROJINHERIT) != 0;
+    }
+    close(fd);
+#else
+    (void)folderPath;
+    (void)info;
+#endif
+    return FsResult::Ok;
+}
+
+struct DirEntry {
+    std::string name;     // UTF-8
     fs::path path;
-    std::uintmax_t size;
-    bool accessDenied;
+    EntryType type;       // symlinks and special files are Other
 };
 
-#include <map>
-std::map<std::string, std::vector<FolderEntry>> globalCache;
+/**
+ * Every blocking filesystem call the scanners make goes through one of
+ * these, so calls can be put under a deadline or faked.
+ */
+class FsBackend {
+public:
+    virtual ~FsBackend() = default;
+    virtual FsResult list(const fs::path& folder, std::vector<DirEntry>& entries) = 0;
+    virtual FsResult stat(const fs::path& path, EntryInfo& info) = 0;
+    virtual FsResult project(const fs::path& folder, ProjectInfo& info) = 0;
+};
 
-std::vector<FolderEntry> getSubfolders(const fs::path& parentPath) {
-    std::vector<FolderEntry> folders;
-    std::error_code ec;
-    
-    auto dirIter = fs::directory_iterator(parentPath, ec);
-    if (ec) {
-        return folders; // Empty if can't read
+/**
+ * The real filesystem
+ */
+class LocalBackend : public FsBackend {
+public:
+    FsResult list(const fs::path& folder, std::vector<DirEntry>& entries) override {
+        std::error_code ec;
+
+        std::uint64_t traceStart = traceNow();
+        auto dirIter = fs::directory_iterator(folder, ec);
+        traceSpan(TRACE_OPEN, traceStart, folder);
+        if (ec) {
+            // Access denied or other error
+            return FsResult::Error;
+        }
+
+        traceStart = traceNow();
+        for (; dirIter != fs::directory_iterator(); dirIter.increment(ec)) {
+            if (ec) break;
+            const auto& entry = *dirIter;
+            std::error_code entryEc;
+
+            EntryType type = EntryType::Other;
+            if (!followSymlinks && entry.is_symlink(entryEc)) {
+                type = EntryType::Other;
+            } else if (entry.is_directory(entryEc) && !entryEc) {
+                type = EntryType::Folder;
+            } else if (entry.is_regular_file(entryEc) && !entryEc) {
+                type = EntryType::File;
+            }
+            entries.push_back({entry.path().filename().u8string(), entry.path(), type});
+        }
+        traceSpan(TRACE_LIST, traceStart, folder);
+        return FsResult::Ok;
+    }
+
+    FsResult stat(const fs::path& path, EntryInfo& info) override {
+        std::uint64_t traceStart = traceNow();
+        bool ok = readEntryInfo(path, info);
+        traceSpan(TRACE_STAT, traceStart, path);
+        return ok ? FsResult::Ok : FsResult::Error;
+    }
+
+    FsResult project(const fs::path& folder, ProjectInfo& info) override {
+        return readProjectInfo(folder, info);
+    }
+};
+
+/**
+ * Test backend: any call on a path containing `pattern` blocks (for an
+ * hour), like a hard-mounted NFS server that went away.
+ */
+class HangingBackend : public FsBackend {
+public:
+    HangingBackend(FsBackend& inner, std::string pattern) : inner(inner), pattern(std::move(pattern)) {}
+
+    FsResult list(const fs::path& folder, std::vector<DirEntry>& entries) override {
+        hangIfMatched(folder);
+        return inner.list(folder, entries);
+    }
+
+    FsResult stat(const fs::path& path, EntryInfo& info) override {
+        hangIfMatched(path);
+        return inner.stat(path, info);
+    }
+
+    FsResult project(const fs::path& folder, ProjectInfo& info) override {
+        hangIfMatched(folder);
+        return inner.project(folder, info);
+    }
+
+private:
+    void hangIfMatched(const fs::path& path) {
+        if (path.u8string().find(pattern) != std::string::npos) {
+            std::this_thread::sleep_for(std::chrono::hours(1));
+        }
+    }
+
+    FsBackend& inner;
+    std::string pattern;
+};
+
+/**
+ * Helper thread that runs one scan thread's filesystem calls. If a call
+ * hangs, the helper is abandoned (left blocked) and the scan thread gets
+ * a fresh one.
+ */
+struct HelperThread {
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> jobs;
+        bool quit = false;
+    };
+    std::shared_ptr<Queue> queue = std::make_shared<Queue>();
+    std::thread thread;
+
+    HelperThread() {
+        thread = std::thread([q = queue]() {
+            while (true) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(q->mutex);
+                    q->wake.wait(lock, [&q]() { return q->quit || !q->jobs.empty(); });
+                    if (q->quit) return;
+                    job = std::move(q->jobs.front());
+                    q->jobs.pop_front();
+                }
+                job();
+            }
+        });
+    }
+
+    ~HelperThread() {
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->quit = true;
+        }
+        queue->wake.notify_one();
+        if (thread.joinable()) thread.join();
+    }
+
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->jobs.push_back(std::move(job));
+        }
+        queue->wake.notify_one();
+    }
+
+    // The thread exits by itself once its blocked call returns
+    void abandon() {
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->quit = true;
+        }
+        thread.detach();
+    }
+};
+
+thread_local std::unique_ptr<HelperThread> scanHelper;
+std::atomic<std::uint64_t> timedOutCalls{0};
+
+/**
+ * Runs fn on this thread's helper and waits at most `deadline`.
+ * Returns false (and leaves the helper behind) if it didn't finish.
+ */
+template <typename T>
+bool runWithDeadline(std::function<T()> fn, std::chrono::milliseconds deadline, T& result) {
+    if (!scanHelper) {
+        scanHelper = std::make_unique<HelperThread>();
+    }
+
+    // The task owns its result, so an abandoned call can still finish safely
+    auto task = std::make_shared<std::packaged_task<T()>>(std::move(fn));
+    std::future<T> future = task->get_future();
+    scanHelper->post([task]() { (*task)(); });
+
+    if (future.wait_for(deadline) == std::future_status::timeout) {
+        scanHelper->abandon();
+        scanHelper.reset();
+        timedOutCalls++;
+        return false;
+    }
+    result = future.get();
+    return true;
+}
+
+/**
+ * Puts every call of another backend under a per-call deadline
+ */
+class WatchdogBackend : public FsBackend {
+public:
+    WatchdogBackend(FsBackend& inner, std::chrono::milliseconds deadline) : inner(inner), deadline(deadline) {}
+
+    FsResult list(const fs::path& folder, std::vector<DirEntry>& entries) override {
+        using Listing = std::pair<FsResult, std::vector<DirEntry>>;
+        FsBackend* backend = &inner;
+        Listing listing;
+        bool finished = runWithDeadline<Listing>([backend, folder]() {
+            Listing l;
+            l.first = backend->list(folder, l.second);
+            return l;
+        }, deadline, listing);
+
+        if (!finished) return FsResult::TimedOut;
+        entries = std::move(listing.second);
+        return listing.first;
+    }
+
+    FsResult stat(const fs::path& path, EntryInfo& info) override {
+        using Stat = std::pair<FsResult, EntryInfo>;
+        FsBackend* backend = &inner;
+        Stat st;
+        bool finished = runWithDeadline<Stat>([backend, path]() {
+            Stat s;
+            s.first = backend->stat(path, s.second);
+            return s;
+        }, deadline, st);
+
+        if (!finished) return FsResult::TimedOut;
+        info = st.second;
+        return st.first;
+    }
+
+    FsResult project(const fs::path& folder, ProjectInfo& info) override {
+        using Project = std::pair<FsResult, ProjectInfo>;
+        FsBackend* backend = &inner;
+        Project pr;
+        bool finished = runWithDeadline<Project>([backend, folder]() {
+            Project p;
+            p.first = backend->project(folder, p.second);
+            return p;
+        }, deadline, pr);
+
+        if (!finished) return FsResult::TimedOut;
+        info = pr.second;
+        return pr.first;
+    }
+
+private:
+    FsBackend& inner;
+    std::chrono::milliseconds deadline;
+};
+
+/**
+ * Trace of a scan's filesystem calls (--record / --replay). Paths are
+ * stored as (folder id, name): a folder is defined once by a 'F' record
+ * and referred to by number after that. Numbers are LEB128 varints.
+ *
+ *   'F' parent+1 (0 = absolute path follows), name
+ *   'L' folder, result, latency ns, count, count x (type, name)
+ *   'S' folder+1 (0 = absolute), name, result, latency ns, size, alloc, mtime (zigzag), uid, device, inode,
+ *       type
+ *   'P' folder, result, latency ns, project id, inherit
+ */
+const char REPLAY_MAGIC[8] = {'D', 'S', 'R', 'E', 'P', 'L', '0', '2'};
+
+void appendVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void appendString(std::string& out, const std::string& text) {
+    appendVarint(out, text.size());
+    out += text;
+}
+
+/**
+ * Passes every call through to another backend and keeps a compact
+ * record of it, with its latency, for writeRecording().
+ */
+class RecordingBackend : public FsBackend {
+public:
+    explicit RecordingBackend(FsBackend& inner) : inner(inner) {}
+
+    FsResult list(const fs::path& folder, std::vector<DirEntry>& entries) override {
+        auto start = std::chrono::steady_clock::now();
+        FsResult result = inner.list(folder, entries);
+        std::uint64_t latency = elapsedNs(start);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::uint64_t id = folderId(folder);
+        records += 'L';
+        appendVarint(records, id);
+        records += static_cast<char>(result);
+        appendVarint(records, latency);
+        appendVarint(records, entries.size());
+        for (const DirEntry& entry : entries) {
+            records += static_cast<char>(entry.type);
+            appendString(records, entry.name);
+        }
+        calls++;
+        return result;
+    }
+
+    FsResult stat(const fs::path& path, EntryInfo& info) override {
+        auto start = std::chrono::steady_clock::now();
+        FsResult result = inner.stat(path, info);
+        std::uint64_t latency = elapsedNs(start);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::uint64_t parent = hasParent(path) ? folderId(path.parent_path()) + 1 : 0;
+        records += 'S';
+        appendVarint(records, parent);
+        appendString(records, parent ? path.filename().u8string() : path.u8string());
+        records += static_cast<char>(result);
+        appendVarint(records, latency);
+        appendVarint(records, info.size);
+        appendVarint(records, info.alloc);
+        appendVarint(records, static_cast<std::uint64_t>(info.mtime) << 1 ^ static_cast<std::uint64_t>(info.mtime >> 63));
+        appendVarint(records, info.uid);
+        appendVarint(records, info.device);
+        appendVarint(records, info.inode);
+        records += static_cast<char>(info.type);
+        calls++;
+        return result;
+    }
+
+    FsResult project(const fs::path& folder, ProjectInfo& info) override {
+        auto start = std::chrono::steady_clock::now();
+        FsResult result = inner.project(folder, info);
+        std::uint64_t latency = elapsedNs(start);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::uint64_t id = folderId(folder);
+        records += 'P';
+        appendVarint(records, id);
+        records += static_cast<char>(result);
+        appendVarint(records, latency);
+        appendVarint(records, info.id);
+        records += static_cast<char>(info.inherit ? 1 : 0);
+        calls++;
+        return result;
+    }
+
+    /** Writes the trace; `root` is where the recorded scan started */
+    bool write(const fs::path& outFile, const fs::path& root) {
+        std::ofstream out(outFile, std::ios::binary);
+        if (!out) {
+            std::cerr << "Error: Cannot create " << outFile << "\n";
+            return false;
+        }
+        std::string header(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+        std::lock_guard<std::mutex> lock(mutex);
+        appendString(header, root.u8string());
+        appendVarint(header, calls);
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+        out.write(records.data(), static_cast<std::streamsize>(records.size()));
+        if (!out) {
+            std::cerr << "Error: Failed writing " << outFile << "\n";
+            return false;
+        }
+        std::cout << "  Recorded " << calls << " filesystem calls to " << outFile.string()
+                  << " (" << formatSize(records.size() + header.size()) << ")\n";
+        return true;
+    }
+
+private:
+    static std::uint64_t elapsedNs(std::chrono::steady_clock::time_point start) {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    static bool hasParent(const fs::path& path) {
+        return path.has_filename() && path.has_parent_path() && path.parent_path() != path;
+    }
+
+    // Number of a folder, defining it (and its parents) on first use
+    std::uint64_t folderId(const fs::path& folder) {
+        auto found = folders.find(folder.u8string());
+        if (found != folders.end()) return found->second;
+
+        std::uint64_t parent = hasParent(folder) ? folderId(folder.parent_path()) + 1 : 0;
+        records += 'F';
+        appendVarint(records, parent);
+        appendString(records, parent ? folder.filename().u8string() : folder.u8string());
+        std::uint64_t id = folders.size();
+        folders.emplace(folder.u8string(), id);
+        return id;
+    }
+
+    FsBackend& inner;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::uint64_t> folders;
+    std::string records;
+    std::uint64_t calls = 0;
+};
+
+/**
+ * Answers every call from a recorded trace, at memory speed or after
+ * the recorded latency. Calls the recording never saw fail.
+ */
+class ReplayBackend : public FsBackend {
+public:
+    bool withLatency = false;   // --replay-latency
+    fs::path root;              // where the recorded scan started
+
+    bool load(const fs::path& inFile) {
+        std::ifstream in(inFile, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (data.size() < sizeof(REPLAY_MAGIC) || std::memcmp(data.data(), REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) != 0) {
+            std::cerr << "Error: Not a DiskScope recording: " << inFile << "\n";
+            return false;
+        }
+
+        pos = sizeof(REPLAY_MAGIC);
+        bytes = &data;
+        std::string rootName = readString();
+        std::uint64_t calls = readVarint();
+        root = fs::u8path(rootName);
+
+        std::vector<std::string> folders;
+        while (pos < data.size() && !failed) {
+            char kind = data[pos++];
+            if (kind == 'F') {
+                std::uint64_t parent = readVarint();
+                std::string name = readString();
+                folders.push_back(parent ? childPath(folders, parent - 1, name) : name);
+            } else if (kind == 'L') {
+                std::uint64_t id = readVarint();
+                Listing listing;
+                listing.result = static_cast<FsResult>(readByte());
+                listing.latency = readVarint();
+                std::uint64_t count = readVarint();
+                for (std::uint64_t e = 0; e < count && !failed; ++e) {
+                    auto type = static_cast<EntryType>(readByte());
+                    listing.entries.push_back({readString(), type});
+                }
+                if (id < folders.size()) listings.emplace(folders[id], std::move(listing));
+                else failed = true;
+            } else if (kind == 'S') {
+                std::uint64_t parent = readVarint();
+                std::string name = readString();
+                Stat st;
+                st.result = static_cast<FsResult>(readByte());
+                st.latency = readVarint();
+                st.info.size = readVarint();
+                st.info.alloc = readVarint();
+                std::uint64_t mtime = readVarint();
+                st.info.mtime = static_cast<std::int64_t>(mtime >> 1) ^ -static_cast<std::int64_t>(mtime & 1);
+                st.info.uid = static_cast<std::uint32_t>(readVarint());
+                st.info.device = readVarint();
+                st.info.inode = readVarint();
+                st.info.type = static_cast<EntryType>(readByte());
+                stats.emplace(parent ? childPath(folders, parent - 1, name) : name, st);
+            } else if (kind == 'P') {
+                std::uint64_t id = readVarint();
+                Project pr;
+                pr.result = static_cast<FsResult>(readByte());
+                pr.latency = readVarint();
+                pr.info.id = static_cast<std::uint32_t>(readVarint());
+                pr.info.inherit = readByte() != 0;
+                if (id < folders.size()) projects.emplace(folders[id], pr);
+                else failed = true;
+            } else {
+                failed = true;
+            }
+        }
+        bytes = nullptr;
+        if (failed || root.empty()) {
+            std::cerr << "Error: Damaged recording: " << inFile << "\n";
+            return false;
+        }
+        std::cout << "  Replaying " << calls << " filesystem calls recorded below " << root.string() << "\n";
+        return true;
+    }
+
+    FsResult list(const fs::path& folder, std::vector<DirEntry>& entries) override {
+        auto found = listings.find(folder.u8string());
+        if (found == listings.end()) return FsResult::Error;
+        const Listing& listing = found->second;
+        delay(listing.latency);
+        for (const auto& entry : listing.entries) {
+            entries.push_back({entry.first, folder / fs::u8path(entry.first), entry.second});
+        }
+        return listing.result;
+    }
+
+    FsResult stat(const fs::path& path, EntryInfo& info) override {
+        auto found = stats.find(path.u8string());
+        if (found == stats.end()) return FsResult::Error;
+        delay(found->second.latency);
+        info = found->second.info;
+        return found->second.result;
+    }
+
+    // Not recorded: no project id
+    FsResult project(const fs::path& folder, ProjectInfo& info) override {
+        auto found = projects.find(folder.u8string());
+        if (found == projects.end()) return FsResult::Ok;
+        delay(found->second.latency);
+        info = found->second.info;
+        return found->second.result;
+    }
+
+private:
+    struct Listing {
+        FsResult result;
+        std::uint64_t latency;
+        std::vector<std::pair<std::string, EntryType>> entries;
+    };
+    struct Stat {
+        FsResult result;
+        std::uint64_t latency;
+        EntryInfo info;
+    };
+    struct Project {
+        FsResult result;
+        std::uint64_t latency;
+        ProjectInfo info;
+    };
+
+    void delay(std::uint64_t latency) {
+        if (withLatency) std::this_thread::sleep_for(std::chrono::nanoseconds(latency));
+    }
+
+    std::string childPath(const std::vector<std::string>& folders, std::uint64_t parent, const std::string& name) {
+        if (parent >= folders.size()) {
+            failed = true;
+            return name;
+        }
+        return (fs::u8path(folders[parent]) / fs::u8path(name)).u8string();
+    }
+
+    std::uint8_t readByte() {
+        if (pos >= bytes->size()) {
+            failed = true;
+            return 0;
+        }
+        return static_cast<std::uint8_t>((*bytes)[pos++]);
+    }
+
+    std::uint64_t readVarint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t byte = readByte();
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        failed = true;
+        return value;
     }
 
-    struct Task {
-        std::future<std::uintmax_t> future;
-        std::string name;
-        fs::path path;
-    };
-    std::vector<Task> tasks;
-    
-    std::cout << "  Scanning subfolders (Parallel Mode)... " << std::flush;
+    std::string readString() {
+        std::uint64_t length = readVarint();
+        if (failed || length > bytes->size() - pos) {
+            failed = true;
+            return std::string();
+        }
+        std::string text = bytes->substr(pos, length);
+        pos += length;
+        return text;
+    }
+
+    std::unordered_map<std::string, Listing> listings;
+    std::unordered_map<std::string, Stat> stats;
+    std::unordered_map<std::string, Project> projects;
+    // Parse state, only while loading
+    const std::string* bytes = nullptr;
+    std::size_t pos = 0;
+    bool failed = false;
+};
+
+LocalBackend localBackend;
+FsBackend* fsBackend = &localBackend;
+
+/**
+ * Folders already counted in --follow mode, keyed by (device, inode) so
+ * symlink cycles end and every real folder is charged once. Sharded so
+ * parallel scan tasks rarely wait on the same lock.
+ */
+class VisitedSet {
+public:
+    // True the first time a folder is seen
+    bool insert(std::uint64_t device, std::uint64_t inode) {
+        std::uint64_t h = (inode ^ (device << 32 | device >> 32)) * 0x9E3779B97F4A7C15ull;
+        Shard& shard = shards[h >> 58];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.seen.insert({device, inode}).second;
+    }
+
+private:
+    struct KeyHash {
+        std::size_t operator()(const std::pair<std::uint64_t, std::uint64_t>& key) const {
+            return std::hash<std::uint64_t>()(key.first * 0x100000001B3ull ^ key.second);
+        }
+    };
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_set<std::pair<std::uint64_t, std::uint64_t>, KeyHash> seen;
+    };
+    std::array<Shard, 64> shards;
+};
+
+/**
+ * False if `visited` already has this folder. Always true without a
+ * visited set or when the platform has no inode numbers.
+ */
+bool firstVisit(VisitedSet* visited, const fs::path& folderPath) {
+    if (!visited) return true;
+    EntryInfo info;
+    if (fsBackend->stat(folderPath, info) != FsResult::Ok || info.inode == 0) return true;
+    return visited->insert(info.device, info.inode);
+}
+
+// ============================================================================
+// METADATA LATENCY (slow-path report)
+// ============================================================================
+
+/**
+ * HDR-style latency histogram in nanoseconds: 16 linear sub-buckets per
+ * power of two, so every recorded value is kept to within ~6%.
+ */
+struct LatencyHistogram {
+    static const int SUB_BUCKETS = 16;
+    static const int BUCKETS = 61 * SUB_BUCKETS;
+
+    std::array<std::atomic<std::uint64_t>, BUCKETS> counts{};
+
+    static int bucketOf(std::uint64_t ns) {
+        if (ns < 2 * SUB_BUCKETS) return static_cast<int>(ns);
+        int shift = 0;
+        while ((ns >> shift) >= 2 * SUB_BUCKETS) shift++;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((ns >> shift) - SUB_BUCKETS);
+    }
+
+    static std::uint64_t bucketValue(int bucket) {
+        if (bucket < 2 * SUB_BUCKETS) return static_cast<std::uint64_t>(bucket);
+        int shift = bucket / SUB_BUCKETS - 1;
+        return static_cast<std::uint64_t>(bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    }
+
+    void record(std::uint64_t ns) {
+        counts[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t total() const {
+        std::uint64_t n = 0;
+        for (const auto& c : counts) n += c.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    // Lower bound of the bucket holding the p-th percentile (0-100)
+    std::uint64_t percentile(double p) const {
+        std::uint64_t n = total();
+        if (n == 0) return 0;
+        std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * static_cast<double>(n - 1));
+        std::uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b].load(std::memory_order_relaxed);
+            if (seen > rank) return bucketValue(b);
+        }
+        return bucketValue(BUCKETS - 1);
+    }
+};
+
+/**
+ * Latency of each kind of metadata operation on one device
+ */
+struct DeviceLatency {
+    std::string label;          // device id plus the first path seen on it
+    LatencyHistogram list;      // opening and reading a directory
+    LatencyHistogram stat;      // stat of a single file
+};
+
+bool latencyEnabled = false;
+std::mutex latencyMutex;
+std::map<std::uint64_t, std::unique_ptr<DeviceLatency>> latencyByDevice;
+
+std::uint64_t latencyNow() {
+    if (!latencyEnabled) return 0;
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Histograms for the device holding folderPath, or nullptr when latency
+ * recording is off. Called once per directory, not per file.
+ */
+DeviceLatency* deviceLatency(const fs::path& folderPath) {
+    if (!latencyEnabled) return nullptr;
+
+#ifdef _WIN32
+    std::string device = folderPath.root_name().string();
+    std::uint64_t key = std::hash<std::string>()(device);
+#else
+    EntryInfo info;
+    fsBackend->stat(folderPath, info);
+    std::uint64_t key = info.device;
+    std::string device = "dev " + std::to_string(key);
+#endif
+
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    auto& slot = latencyByDevice[key];
+    if (!slot) {
+        slot = std::make_unique<DeviceLatency>();
+        slot->label = device + " (" + folderPath.u8string() + ")";
+    }
+    return slot.get();
+}
+
+std::string formatDuration(std::uint64_t ns) {
+    std::ostringstream oss;
+    if (ns < 1000) oss << ns << " ns";
+    else if (ns < 1000000) oss << std::fixed << std::setprecision(1) << ns / 1e3 << " us";
+    else if (ns < 1000000000) oss << std::fixed << std::setprecision(1) << ns / 1e6 << " ms";
+    else oss << std::fixed << std::setprecision(2) << ns / 1e9 << " s";
+    return oss.str();
+}
+
+// ============================================================================
+// OWN SIZE LEADERBOARD (folders by the files directly in them)
+// ============================================================================
+
+const std::size_t OWN_LEADERS = 20;
+
+struct OwnUsage {
+    fs::path path;
+    std::uintmax_t bytes;       // files directly in the folder, not in subfolders
+    std::uint64_t files;
+};
+
+/**
+ * The N largest folders by one key, kept as a min-heap so a new folder
+ * costs one comparison with the smallest, and O(log N) if it gets in.
+ */
+class TopFolders {
+public:
+    explicit TopFolders(bool byFiles) : byFiles(byFiles) {}
+
+    bool accepts(std::uint64_t key) const {
+        return key > 0 && (heap.size() < OWN_LEADERS || key > keyOf(heap.front()));
+    }
+
+    void offer(const OwnUsage& usage) {
+        if (!accepts(keyOf(usage))) return;
+        auto later = [this](const OwnUsage& a, const OwnUsage& b) { return keyOf(a) > keyOf(b); };
+        if (heap.size() == OWN_LEADERS) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            heap.pop_back();
+        }
+        heap.push_back(usage);
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+
+    void merge(const TopFolders& other) {
+        for (const OwnUsage& usage : other.heap) offer(usage);
+    }
+
+    std::uint64_t keyOf(const OwnUsage& usage) const {
+        return byFiles ? usage.files : usage.bytes;
+    }
+
+    /** Largest first */
+    std::vector<OwnUsage> sorted() const {
+        std::vector<OwnUsage> rows = heap;
+        std::sort(rows.begin(), rows.end(), [this](const OwnUsage& a, const OwnUsage& b) {
+            return keyOf(a) > keyOf(b);
+        });
+        return rows;
+    }
+
+private:
+    bool byFiles;
+    std::vector<OwnUsage> heap;
+};
+
+struct OwnLeaders {
+    TopFolders bySize{false};
+    TopFolders byFiles{true};
+
+    void offer(const fs::path& folder, std::uintmax_t bytes, std::uint64_t files) {
+        if (bySize.accepts(bytes) || byFiles.accepts(files)) {
+            OwnUsage usage{folder, bytes, files};
+            bySize.offer(usage);
+            byFiles.offer(usage);
+        }
+    }
+
+    void merge(const OwnLeaders& other) {
+        bySize.merge(other.bySize);
+        byFiles.merge(other.byFiles);
+    }
+};
+
+// The scanning thread's own leaderboard, set by the task that runs it (nullptr = don't collect)
+thread_local OwnLeaders* ownLeaders = nullptr;
+
+// ============================================================================
+// SIZE CALCULATION
+// ============================================================================
+
+// Set on the way out so background scans stop early
+std::atomic<bool> scanCancelled{false};
+
+/**
+ * Total size of everything below folderPath. Sets timedOut if any
+ * part of it couldn't be read before the watchdog deadline. With a
+ * visited set, folders already counted elsewhere count as zero.
+ */
+std::uintmax_t calculateFolderSize(const fs::path& folderPath, bool& timedOut, VisitedSet* visited = nullptr) {
+    std::uintmax_t totalSize = 0;
+    if (scanCancelled || !firstVisit(visited, folderPath)) {
+        return 0;
+    }
+    
+    // Try to list the directory
+    std::vector<DirEntry> entries;
+    FsResult result = fsBackend->list(folderPath, entries);
+    if (result != FsResult::Ok) {
+        // Access denied, other error or hung - return 0
+        timedOut = timedOut || result == FsResult::TimedOut;
+        return 0;
+    }
+    
+    std::uintmax_t ownBytes = 0;
+    std::uint64_t ownFiles = 0;
+    for (const auto& entry : entries) {
+        if (entry.type == EntryType::Folder) {
+            // Recurse into subdirectory
+            totalSize += calculateFolderSize(entry.path, timedOut, visited);
+        }
+        else if (entry.type == EntryType::File) {
+            // Add file size
+            EntryInfo info;
+            result = fsBackend->stat(entry.path, info);
+            if (result == FsResult::TimedOut) {
+                // This folder is stuck, give up on the rest of it
+                timedOut = true;
+                break;
+            }
+            if (result == FsResult::Ok) {
+                totalSize += info.size;
+                ownBytes += info.size;
+                ownFiles++;
+            }
+        }
+    }
+    
+    if (ownLeaders) ownLeaders->offer(folderPath, ownBytes, ownFiles);
+    return totalSize;
+}
+
+// ============================================================================
+// PROJECT QUOTAS (XFS / ext4, Linux)
+// ============================================================================
+
+#ifdef __linux__
+/**
+ * Block device mounted with the given st_dev, from /proc/self/mountinfo
+ * ("" if not found). quotactl() wants the device, not a path.
+ */
+std::string mountSource(std::uint64_t device) {
+    static std::mutex cacheMutex;
+    static std::map<std::uint64_t, std::string> cache;
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto found = cache.find(device);
+    if (found != cache.end()) return found->second;
+
+    std::string wanted = std::to_string(major(device)) + ":" + std::to_string(minor(device));
+    std::string source;
+    std::ifstream mounts("/proc/self/mountinfo");
+    for (std::string line; std::getline(mounts, line);) {
+        // "36 35 98:0 /root /mnt rw,noatime - ext4 /dev/sda1 rw"
+        std::istringstream fields(line);
+        std::string id, parentId, majorMinor;
+        fields >> id >> parentId >> majorMinor;
+        std::size_t dash = line.find(" - ");
+        if (majorMinor != wanted || dash == std::string::npos) continue;
+        std::istringstream tail(line.substr(dash + 3));
+        std::string fsType;
+        tail >> fsType >> source;
+        break;
+    }
+    cache[device] = source;
+    return source;
+}
+#endif
+
+/**
+ * Bytes charged to a project on the device holding st_dev `device`.
+ * False if project quotas aren't enabled there (or not on Linux).
+ */
+bool projectUsage(std::uint64_t device, std::uint32_t projectId, std::uintmax_t& bytes) {
+#ifdef __linux__
+    std::string source = mountSource(device);
+    if (source.empty()) return false;
+    struct dqblk quota;
+    std::memset(&quota, 0, sizeof(quota));
+    if (quotactl(QCMD(Q_GETQUOTA, PRJQUOTA), source.c_str(), static_cast<int>(projectId),
+                 reinterpret_cast<char*>(&quota)) != 0) {
+        return false;
+    }
+    bytes = static_cast<std::uintmax_t>(quota.dqb_curspace);
+    return true;
+#else
+    (void)device;
+    (void)projectId;
+    (void)bytes;
+    return false;
+#endif
+}
+
+// ============================================================================
+// FOLDER INFO (for current level only)
+// ============================================================================
+
+const std::uint32_t NO_NODE = 0xFFFFFFFFu;
+
+struct FolderEntry {
+    std::string name;
+    fs::path path;
+    std::uintmax_t size;
+    bool accessDenied;
+    bool timedOut;      // size is partial, part of the folder hung
+    std::uint32_t node = NO_NODE;       // tree node when browsing a snapshot
+    std::uintmax_t matchedSize = 0;     // bytes matching the active filter
+    bool fromQuota = false;             // size is the project's quota usage (allocated bytes), not scanned
+    bool stale = false;                 // size is from a cached snapshot, not yet rechecked
+};
+
+std::map<std::string, std::vector<FolderEntry>> globalCache;
+
+/**
+ * Indices of `keys` ordered largest first (stable). LSD radix sort on
+ * compact (key, index) pairs, 8 bits per pass, skipping bytes that are
+ * the same in every key. Big inputs run each pass on several threads.
+ */
+std::vector<std::uint32_t> sortIndicesDescending(const std::vector<std::uint64_t>& keys) {
+    struct Item {
+        std::uint64_t key;      // inverted, so ascending order = largest first
+        std::uint32_t index;
+    };
+    const std::size_t n = keys.size();
+    std::vector<Item> items(n), scratch(n);
+    std::uint64_t anyBits = 0, allBits = ~0ull;
+    for (std::size_t i = 0; i < n; ++i) {
+        items[i] = {~keys[i], static_cast<std::uint32_t>(i)};
+        anyBits |= items[i].key;
+        allBits &= items[i].key;
+    }
+    const std::uint64_t varying = anyBits ^ allBits;   // bytes with no varying bit need no pass
+
+    const std::size_t PARALLEL_MIN = 1 << 17;
+    const std::size_t threads = n < PARALLEL_MIN ? 1
+        : std::min<std::size_t>(8, std::max(1u, std::thread::hardware_concurrency()));
+    const std::size_t chunk = (n + threads - 1) / threads;
+    std::vector<std::array<std::size_t, 256>> counts(threads);
+
+    auto forEachChunk = [&](auto body) {
+        if (threads == 1) {
+            body(0);
+            return;
+        }
+        std::vector<std::future<void>> workers;
+        for (std::size_t t = 0; t < threads; ++t) {
+            workers.push_back(std::async(std::launch::async, body, t));
+        }
+        for (auto& worker : workers) worker.get();
+    };
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xFF) == 0) continue;
+
+        forEachChunk([&](std::size_t t) {
+            counts[t].fill(0);
+            for (std::size_t i = t * chunk; i < std::min(n, (t + 1) * chunk); ++i) {
+                counts[t][(items[i].key >> shift) & 0xFF]++;
+            }
+        });
+
+        // Bucket start for each (digit, thread), digits major so the sort stays stable
+        std::size_t offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            for (std::size_t t = 0; t < threads; ++t) {
+                std::size_t c = counts[t][digit];
+                counts[t][digit] = offset;
+                offset += c;
+            }
+        }
+
+        forEachChunk([&](std::size_t t) {
+            auto& next = counts[t];
+            for (std::size_t i = t * chunk; i < std::min(n, (t + 1) * chunk); ++i) {
+                scratch[next[(items[i].key >> shift) & 0xFF]++] = items[i];
+            }
+        });
+        items.swap(scratch);
+    }
+
+    std::vector<std::uint32_t> order(n);
+    for (std::size_t i = 0; i < n; ++i) order[i] = items[i].index;
+    return order;
+}
+
+/** Orders rows by size, largest first (stable); each entry is moved once */
+void sortBySize(std::vector<FolderEntry>& rows) {
+    std::vector<std::uint64_t> sizes;
+    sizes.reserve(rows.size());
+    for (const auto& row : rows) sizes.push_back(row.size);
+    std::vector<FolderEntry> sorted;
+    sorted.reserve(rows.size());
+    for (std::uint32_t index : sortIndicesDescending(sizes)) {
+        sorted.push_back(std::move(rows[index]));
+    }
+    rows.swap(sorted);
+}
+
+// Called as each subfolder is sized (from worker threads), with the number of subfolders
+using FolderProgress = std::function<void(const FolderEntry& folder, std::size_t total)>;
+
+/**
+ * Sizes every subfolder of parentPath in parallel. With `leaders`, the
+ * workers also keep the folders below with the largest own files and
+ * merge them in as they finish.
+ */
+std::vector<FolderEntry> getSubfolders(const fs::path& parentPath, const FolderProgress& progress = nullptr,
+                                       OwnLeaders* leaders = nullptr) {
+    std::vector<FolderEntry> folders;
+    
+    std::vector<DirEntry> entries;
+    if (fsBackend->list(parentPath, entries) != FsResult::Ok) {
+        return folders; // Empty if can't read
+    }
+
+    struct Sized {
+        std::uintmax_t size = 0;
+        bool timedOut = false;
+        std::uint32_t quotaProject = 0;     // size is this project's quota usage, not scanned
+    };
+    struct Task {
+        std::future<Sized> future;
+        std::string name;
+        fs::path path;
+    };
+    std::mutex leadersMutex;
+    std::vector<Task> tasks;
+    
+    // --follow: shared by all tasks so each real folder is counted once
+    auto visited = followSymlinks ? std::make_shared<VisitedSet>() : nullptr;
+    firstVisit(visited.get(), parentPath);
+    
+    // A folder with its own inheriting project id is usually that whole
+    // project: take its usage from the quota subsystem instead of walking.
+    // Approximate - files elsewhere with the same id count too, and nested
+    // folders moved in with another id don't - so a project shared by two
+    // siblings is walked after all (below)
+    ProjectInfo parentProject;
+    fsBackend->project(parentPath, parentProject);
+    
+    std::size_t folderCount = 0;
+    for (const auto& entry : entries) {
+        folderCount += entry.type == EntryType::Folder;
+    }
+    if (!progress) {
+        std::cout << "  Scanning subfolders (Parallel Mode)... " << std::flush;
+    }
+
+    auto sizeFolder = [visited, leaders, &leadersMutex](const fs::path& path, std::uint32_t parentId,
+                                                        bool quotaAllowed) {
+        Sized sized;
+        ProjectInfo project;
+        EntryInfo info;
+        std::uintmax_t quotaBytes = 0;
+        if (quotaAllowed && fsBackend->project(path, project) == FsResult::Ok &&
+            project.id != 0 && project.id != parentId && project.inherit &&
+            fsBackend->stat(path, info) == FsResult::Ok && projectUsage(info.device, project.id, quotaBytes)) {
+            sized.size = quotaBytes;
+            sized.quotaProject = project.id;
+            return sized;
+        }
+
+        OwnLeaders found;
+        if (leaders) ownLeaders = &found;
+        sized.size = calculateFolderSize(path, sized.timedOut, visited.get());
+        ownLeaders = nullptr;
+        if (leaders) {
+            std::lock_guard<std::mutex> lock(leadersMutex);
+            leaders->merge(found);
+        }
+        return sized;
+    };
+
+    // The parent's own files are stat'ed in the same pass, while the workers run
+    std::uintmax_t ownBytes = 0;
+    std::uint64_t ownFiles = 0;
+    for (const auto& entry : entries) {
+        EntryInfo info;
+        if (entry.type == EntryType::File && leaders && fsBackend->stat(entry.path, info) == FsResult::Ok) {
+            ownBytes += info.size;
+            ownFiles++;
+        }
+        // Only process directories
+        if (entry.type == EntryType::Folder) {
+            // Launch async task for each folder
+            traceTaskQueued();
+            tasks.push_back({
+                std::async(std::launch::async, [name = entry.name, path = entry.path, &progress, sizeFolder,
+                                                folderCount, parentId = parentProject.id]() {
+                    std::uint64_t taskStart = traceNow();
+                    Sized sized = sizeFolder(path, parentId, true);
+                    traceTaskDone(taskStart, path);
+                    if (progress && sized.quotaProject == 0) {
+                        FolderEntry folder;
+                        folder.name = name;
+                        folder.path = path;
+                        folder.size = sized.size;
+                        folder.accessDenied = false;
+                        folder.timedOut = sized.timedOut;
+                        progress(folder, folderCount);
+                    }
+                    return sized;
+                }),
+                entry.name,
+                entry.path
+            });
+        }
+    }
+    
+    if (leaders) {
+        std::lock_guard<std::mutex> lock(leadersMutex);
+        leaders->offer(parentPath, ownBytes, ownFiles);
+    }
+    
+    // Collect results
+    std::vector<Sized> results;
+    std::map<std::uint32_t, int> projectFolders;
+    for (auto& task : tasks) {
+        // .get() waits for the thread to finish
+        results.push_back(task.future.get());
+        if (results.back().quotaProject != 0) projectFolders[results.back().quotaProject]++;
+    }
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        Sized& sized = results[i];
+        if (sized.quotaProject != 0 && projectFolders[sized.quotaProject] > 1) {
+            sized = sizeFolder(tasks[i].path, parentProject.id, false);
+        }
+        
+        FolderEntry folder;
+        folder.name = tasks[i].name;
+        folder.path = tasks[i].path;
+        folder.size = sized.size;
+        folder.accessDenied = false;
+        folder.timedOut = sized.timedOut;
+        folder.fromQuota = sized.quotaProject != 0;
+        if (progress && folder.fromQuota) progress(folder, folderCount);
+        
+        folders.push_back(folder);
+    }
+    
+    // Sort by size descending (largest first)
+    sortBySize(folders);
+    return folders;
+}
+
+// ============================================================================
+// FULL TREE SCAN (used by the report writers)
+// ============================================================================
+
+bool archivesEnabled = false;   // --archives: list archive members as folders
+
+bool isArchiveName(std::string_view name) {
+    std::string lower = lowerCase(name);
+    return endsWith(lower, ".zip") || endsWith(lower, ".jar") || endsWith(lower, ".tar") ||
+           endsWith(lower, ".tar.gz") || endsWith(lower, ".tgz");
+}
+
+/**
+ * An archive found while scanning, expanded by expandArchives()
+ */
+struct ArchiveJob {
+    std::uint32_t folder;       // node of the folder holding it
+    std::string name;
+    fs::path path;
+    EntryInfo info;
+};
+
+/**
+ * Every file and folder under a root, stored as parallel arrays.
+ * Node 0 is the root. Names are packed back to back in one pool.
+ */
+struct ScanTree {
+    fs::path rootPath;
+    std::string namePool;
+    std::vector<std::uint64_t> nameStart{0};  // name i = [nameStart[i], nameStart[i + 1])
+    std::int64_t scannedAt = 0;                // Unix time the scan finished
+    std::vector<std::uint32_t> parent;
+    std::vector<std::uint32_t> subtreeEnd;     // set by finalizeTree()
+    std::vector<std::uint32_t> firstChild;     // child links, only while building
+    std::vector<std::uint32_t> nextSibling;
+    std::vector<std::uintmax_t> size;          // file size, or total size for folders
+    std::vector<std::uintmax_t> alloc;         // allocated bytes, totalled like size
+    std::vector<std::int64_t> mtime;
+    std::vector<std::uint32_t> uid;
+    std::vector<std::uint8_t> isFolder;
+    std::vector<std::uint8_t> timedOut;        // 1 = folder hung, its size is partial
+    // Own open + list + stat time of each folder, only with --slow-report
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> folderNanos;
+    std::vector<ArchiveJob> archives;          // pending, only with --archives
+    OwnLeaders ownLeaders;                     // collected by buildTree() while scanning
+
+    std::uint32_t count() const {
+        return static_cast<std::uint32_t>(parent.size());
+    }
+
+    std::string_view name(std::uint32_t node) const {
+        return std::string_view(namePool).substr(nameStart[node], nameStart[node + 1] - nameStart[node]);
+    }
+
+    std::uint32_t addNode(std::uint32_t parentNode, std::string_view nodeName,
+                          const EntryInfo& info, bool folder) {
+        std::uint32_t node = count();
+        namePool.append(nodeName.data(), nodeName.size());
+        nameStart.push_back(namePool.size());
+        parent.push_back(parentNode);
+        firstChild.push_back(NO_NODE);
+        nextSibling.push_back(NO_NODE);
+        size.push_back(info.size);
+        alloc.push_back(info.alloc);
+        mtime.push_back(info.mtime);
+        uid.push_back(info.uid);
+        isFolder.push_back(folder ? 1 : 0);
+        timedOut.push_back(0);
+
+        // Link as the first child of the parent
+        if (parentNode != NO_NODE) {
+            nextSibling[node] = firstChild[parentNode];
+            firstChild[parentNode] = node;
+        }
+        return node;
+    }
+};
+
+/**
+ * Adds a folder node. Its size and alloc start at zero and are
+ * filled in as its contents are scanned.
+ */
+std::uint32_t addFolderNode(ScanTree& tree, std::uint32_t parentNode,
+                            std::string_view nodeName, const fs::path& folderPath) {
+    EntryInfo info;
+    FsResult result = fsBackend->stat(folderPath, info);
+    info.size = 0;
+    info.alloc = 0;
+    std::uint32_t node = tree.addNode(parentNode, nodeName, info, true);
+    tree.timedOut[node] = result == FsResult::TimedOut ? 1 : 0;
+    return node;
+}
+
+/**
+ * Recursively adds the contents of folderPath below node `folder` and
+ * totals them into its size, same rules as calculateFolderSize().
+ */
+void scanIntoTree(ScanTree& tree, std::uint32_t folder, const fs::path& folderPath,
+                  VisitedSet* visited = nullptr) {
+    if (tree.timedOut[folder] || scanCancelled || !firstVisit(visited, folderPath)) {
+        return;
+    }
+
+    DeviceLatency* latency = deviceLatency(folderPath);
+    std::uint64_t folderStart = latencyNow();
+    std::uint64_t childNanos = 0;
+
+    std::vector<DirEntry> entries;
+    FsResult result = fsBackend->list(folderPath, entries);
+    std::uint64_t listNanos = latencyNow() - folderStart;
+    if (result != FsResult::Ok) {
+        tree.timedOut[folder] = result == FsResult::TimedOut ? 1 : 0;
+        return;
+    }
+
+    std::uintmax_t ownBytes = 0;
+    std::uint64_t ownFiles = 0;
+    for (const auto& entry : entries) {
+        if (entry.type == EntryType::Folder) {
+            std::uint32_t child = addFolderNode(tree, folder, entry.name, entry.path);
+            std::uint64_t childStart = latencyNow();
+            scanIntoTree(tree, child, entry.path, visited);
+            childNanos += latencyNow() - childStart;
+            tree.size[folder] += tree.size[child];
+            tree.alloc[folder] += tree.alloc[child];
+        }
+        else if (entry.type == EntryType::File) {
+            EntryInfo info;
+            std::uint64_t statStart = latencyNow();
+            result = fsBackend->stat(entry.path, info);
+            if (latency) latency->stat.record(latencyNow() - statStart);
+            if (result == FsResult::TimedOut) {
+                // This folder is stuck, give up on the rest of it
+                tree.timedOut[folder] = 1;
+                break;
+            }
+            if (result == FsResult::Ok && archivesEnabled && isArchiveName(entry.name)) {
+                tree.archives.push_back({folder, entry.name, entry.path, info});
+            } else if (result == FsResult::Ok) {
+                tree.addNode(folder, entry.name, info, false);
+                tree.size[folder] += info.size;
+                tree.alloc[folder] += info.alloc;
+            }
+            if (result == FsResult::Ok) {
+                ownBytes += info.size;
+                ownFiles++;
+            }
+        }
+    }
+
+    if (ownLeaders) ownLeaders->offer(folderPath, ownBytes, ownFiles);
+    if (latency) {
+        // Time spent in this folder alone, without its subfolders
+        std::uint64_t ownNanos = latencyNow() - folderStart - childNanos;
+        latency->list.record(listNanos);
+        tree.folderNanos.push_back({folder, ownNanos});
+    }
+}
+
+/**
+ * Appends `sub` (rooted at its node 0) as a child of `parentNode`.
+ */
+void appendSubtree(ScanTree& tree, std::uint32_t parentNode, const ScanTree& sub) {
+    const std::uint32_t offset = tree.count();
+    const std::uint64_t poolOffset = tree.namePool.size();
+    auto shift = [offset](std::uint32_t index) {
+        return index == NO_NODE ? NO_NODE : index + offset;
+    };
+
+    tree.namePool += sub.namePool;
+    for (std::uint32_t i = 0; i < sub.count(); ++i) {
+        tree.nameStart.push_back(sub.nameStart[i + 1] + poolOffset);
+        tree.parent.push_back(i == 0 ? parentNode : shift(sub.parent[i]));
+        tree.firstChild.push_back(shift(sub.firstChild[i]));
+        tree.nextSibling.push_back(shift(sub.nextSibling[i]));
+        tree.size.push_back(sub.size[i]);
+        tree.alloc.push_back(sub.alloc[i]);
+        tree.mtime.push_back(sub.mtime[i]);
+        tree.uid.push_back(sub.uid[i]);
+        tree.isFolder.push_back(sub.isFolder[i]);
+        tree.timedOut.push_back(sub.timedOut[i]);
+    }
+    for (const auto& timing : sub.folderNanos) {
+        tree.folderNanos.push_back({timing.first + offset, timing.second});
+    }
+
+    tree.nextSibling[offset] = tree.firstChild[parentNode];
+    tree.firstChild[parentNode] = offset;
+    tree.size[parentNode] += sub.size[0];
+    tree.alloc[parentNode] += sub.alloc[0];
+}
+
+/**
+ * Lays the tree out in DFS pre-order with every folder's children
+ * sorted largest first. Afterwards node i's subtree is exactly the
+ * index range [i, subtreeEnd[i]), and the child links are dropped.
+ */
+void finalizeTree(ScanTree& tree) {
+    const std::uint32_t n = tree.count();
+
+    // Visit order: pop the largest child first
+    std::vector<std::uint32_t> order;
+    order.reserve(n);
+    std::vector<std::uint32_t> stack{0};
+    std::vector<std::uint32_t> kids;
+    while (!stack.empty()) {
+        std::uint32_t node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+
+        kids.clear();
+        for (std::uint32_t c = tree.firstChild[node]; c != NO_NODE; c = tree.nextSibling[c]) {
+            kids.push_back(c);
+        }
+        std::sort(kids.begin(), kids.end(), [&tree](std::uint32_t a, std::uint32_t b) {
+            return tree.size[a] < tree.size[b];
+        });
+        stack.insert(stack.end(), kids.begin(), kids.end());
+    }
+
+    std::vector<std::uint32_t> newIndex(n);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        newIndex[order[i]] = i;
+    }
+
+    auto gather = [&order](auto& column) {
+        std::remove_reference_t<decltype(column)> sorted(column.size());
+        for (std::size_t i = 0; i < order.size(); ++i) sorted[i] = column[order[i]];
+        column.swap(sorted);
+    };
+    gather(tree.size);
+    gather(tree.alloc);
+    gather(tree.mtime);
+    gather(tree.uid);
+    gather(tree.isFolder);
+    gather(tree.timedOut);
+
+    std::vector<std::uint32_t> parent(n);
+    std::string namePool;
+    namePool.reserve(tree.namePool.size());
+    std::vector<std::uint64_t> nameStart{0};
+    nameStart.reserve(n + 1);
+    for (std::uint32_t i = 0; i < n; ++i) {
+        std::uint32_t old = order[i];
+        parent[i] = tree.parent[old] == NO_NODE ? NO_NODE : newIndex[tree.parent[old]];
+        namePool += tree.name(old);
+        nameStart.push_back(namePool.size());
+    }
+    tree.parent.swap(parent);
+    tree.namePool.swap(namePool);
+    tree.nameStart.swap(nameStart);
+
+    for (auto& timing : tree.folderNanos) {
+        timing.first = newIndex[timing.first];
+    }
+
+    // Parents come before children, so one backwards pass finds the ends
+    tree.subtreeEnd.resize(n);
+    for (std::uint32_t i = 0; i < n; ++i) tree.subtreeEnd[i] = i + 1;
+    for (std::uint32_t i = n; i-- > 1;) {
+        std::uint32_t p = tree.parent[i];
+        tree.subtreeEnd[p] = std::max(tree.subtreeEnd[p], tree.subtreeEnd[i]);
+    }
+
+    std::vector<std::uint32_t>().swap(tree.firstChild);
+    std::vector<std::uint32_t>().swap(tree.nextSibling);
+}
+
+void expandArchives(ScanTree& tree);   // see ARCHIVES below
+
+/**
+ * Scans the whole tree below rootPath, one parallel task per top-level folder.
+ */
+ScanTree buildTree(const fs::path& rootPath, bool verbose = true) {
+    ScanTree tree;
+    tree.rootPath = rootPath;
+    addFolderNode(tree, NO_NODE, rootPath.u8string(), rootPath);
+
+    std::vector<DirEntry> entries;
+    FsResult result = fsBackend->list(rootPath, entries);
+    if (result != FsResult::Ok) {
+        tree.timedOut[0] = result == FsResult::TimedOut ? 1 : 0;
+        finalizeTree(tree);
+        return tree;
+    }
+
+    std::vector<std::future<ScanTree>> tasks;
+    auto visited = followSymlinks ? std::make_shared<VisitedSet>() : nullptr;
+    firstVisit(visited.get(), rootPath);
+
+    if (verbose) {
+        std::cout << "  Scanning full tree (Parallel Mode)... " << std::flush;
+    }
+
+    std::uintmax_t rootBytes = 0;
+    std::uint64_t rootFiles = 0;
+    for (const auto& entry : entries) {
+        if (entry.type == EntryType::Folder) {
+            // Each top-level folder gets its own tree, merged below
+            traceTaskQueued();
+            tasks.push_back(std::async(std::launch::async, [entry, visited]() {
+                std::uint64_t taskStart = traceNow();
+                ScanTree sub;
+                ownLeaders = &sub.ownLeaders;       // this worker's top folders, merged below
+                addFolderNode(sub, NO_NODE, entry.name, entry.path);
+                scanIntoTree(sub, 0, entry.path, visited.get());
+                ownLeaders = nullptr;
+                expandArchives(sub);
+                traceTaskDone(taskStart, entry.path);
+                return sub;
+            }));
+        }
+        else if (entry.type == EntryType::File) {
+            EntryInfo info;
+            result = fsBackend->stat(entry.path, info);
+            if (result == FsResult::Ok && archivesEnabled && isArchiveName(entry.name)) {
+                tree.archives.push_back({0, entry.name, entry.path, info});
+            } else if (result == FsResult::Ok) {
+                tree.addNode(0, entry.name, info, false);
+                tree.size[0] += info.size;
+                tree.alloc[0] += info.alloc;
+            } else if (result == FsResult::TimedOut) {
+                tree.timedOut[0] = 1;
+            }
+            if (result == FsResult::Ok) {
+                rootBytes += info.size;
+                rootFiles++;
+            }
+        }
+    }
+
+    tree.ownLeaders.offer(rootPath, rootBytes, rootFiles);
+    for (auto& task : tasks) {
+        ScanTree sub = task.get();
+        tree.ownLeaders.merge(sub.ownLeaders);
+        appendSubtree(tree, 0, sub);
+    }
+    expandArchives(tree);
+    finalizeTree(tree);
+    tree.scannedAt = static_cast<std::int64_t>(std::time(nullptr));
+
+    if (!verbose) {
+        return tree;
+    }
+    std::cout << tree.count() << " entries\n";
+    if (timedOutCalls > 0) {
+        std::cout << "  Warning: " << timedOutCalls << " filesystem calls timed out, sizes are partial\n";
+    }
+    return tree;
+}
+
+/**
+ * Children of a folder, largest first (needs a finalized tree)
+ */
+std::vector<std::uint32_t> sortedChildren(const ScanTree& tree, std::uint32_t folder) {
+    std::vector<std::uint32_t> kids;
+    for (std::uint32_t c = folder + 1; c < tree.subtreeEnd[folder]; c = tree.subtreeEnd[c]) {
+        kids.push_back(c);
+    }
+    return kids;
+}
+
+/**
+ * Prefix sums of a per-node value in DFS order. Any subtree is one
+ * contiguous range, so its total is two lookups.
+ */
+struct SubtreeSums {
+    std::vector<std::uint64_t> prefix{0};
+
+    std::uint64_t of(const ScanTree& tree, std::uint32_t node) const {
+        return prefix[tree.subtreeEnd[node]] - prefix[node];
+    }
+};
+
+template <typename ValueFn>
+SubtreeSums buildSubtreeSums(const ScanTree& tree, ValueFn value) {
+    SubtreeSums sums;
+    sums.prefix.resize(tree.count() + 1);
+    for (std::uint32_t i = 0; i < tree.count(); ++i) {
+        sums.prefix[i + 1] = sums.prefix[i] + value(i);
+    }
+    return sums;
+}
+
+/**
+ * Finds the node for a path inside the tree, or NO_NODE
+ */
+std::uint32_t findNode(const ScanTree& tree, const fs::path& path) {
+    fs::path relative = path.lexically_relative(tree.rootPath);
+    if (relative.empty() || *relative.begin() == "..") {
+        return NO_NODE;
+    }
+
+    std::uint32_t node = 0;
+    for (const auto& part : relative) {
+        std::string name = part.u8string();
+        if (name == "." || name.empty()) continue;
+
+        std::uint32_t found = NO_NODE;
+        for (std::uint32_t c = node + 1; c < tree.subtreeEnd[node]; c = tree.subtreeEnd[c]) {
+            if (tree.name(c) == name) {
+                found = c;
+                break;
+            }
+        }
+        if (found == NO_NODE) return NO_NODE;
+        node = found;
+    }
+    return node;
+}
+
+/**
+ * Full path of a node, rebuilt from the names of its ancestors
+ */
+std::string nodePath(const ScanTree& tree, std::uint32_t node) {
+    std::vector<std::uint32_t> chain;
+    for (std::uint32_t n = node; n != NO_NODE; n = tree.parent[n]) {
+        chain.push_back(n);
+    }
+
+    std::string path(tree.name(chain.back()));
+    for (std::size_t i = chain.size() - 1; i-- > 0;) {
+        if (path.empty() || path.back() != static_cast<char>(fs::path::preferred_separator)) {
+            path += static_cast<char>(fs::path::preferred_separator);
+        }
+        path += tree.name(chain[i]);
+    }
+    return path;
+}
+
+// ============================================================================
+// ARCHIVES (browse .zip / .tar / .tar.gz as folders, never extracted)
+// ============================================================================
+
+/**
+ * Collects archive members into a small tree. Node 0 is the archive;
+ * member folders are created on demand from the member paths.
+ */
+struct ArchiveBuilder {
+    ScanTree tree;
+    std::map<std::string, std::uint32_t> folders;   // member folder path -> node
+
+    std::uint32_t folderFor(const std::string& path) {
+        if (path.empty()) return 0;
+        auto found = folders.find(path);
+        if (found != folders.end()) return found->second;
+
+        std::size_t slash = path.rfind('/');
+        std::uint32_t parent = folderFor(slash == std::string::npos ? std::string() : path.substr(0, slash));
+        EntryInfo info;
+        std::uint32_t node = tree.addNode(parent, slash == std::string::npos ? path : path.substr(slash + 1), info, true);
+        folders[path] = node;
+        return node;
+    }
+
+    void addMember(std::string path, std::uint64_t size, std::int64_t mtime, std::uint32_t uid, bool folder) {
+        // Normalize "./a/b/" and "/a/b" to "a/b"
+        while (path.compare(0, 2, "./") == 0) path.erase(0, 2);
+        while (!path.empty() && path.front() == '/') path.erase(0, 1);
+        while (!path.empty() && path.back() == '/') path.pop_back();
+        if (path.empty() || path == ".") return;
+
+        if (folder) {
+            tree.mtime[folderFor(path)] = mtime;
+            return;
+        }
+        std::size_t slash = path.rfind('/');
+        std::uint32_t parent = folderFor(slash == std::string::npos ? std::string() : path.substr(0, slash));
+        EntryInfo info;
+        info.size = size;
+        info.mtime = mtime;
+        info.uid = uid;
+        tree.addNode(parent, slash == std::string::npos ? path : path.substr(slash + 1), info, false);
+    }
+
+    // Folder sizes are the sum of their members (parents precede children)
+    void finish() {
+        for (std::uint32_t i = tree.count(); i-- > 1;) {
+            tree.size[tree.parent[i]] += tree.size[i];
+        }
+    }
+};
+
+template <typename T>
+T readLE(const std::uint8_t* p) {
+    T value = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) value |= static_cast<T>(p[i]) << (8 * i);
+    return value;
+}
+
+std::int64_t daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<std::int64_t>(era) * 146097 + doe - 719468;
+}
+
+/**
+ * Reads member names and sizes from a zip's central directory (with
+ * ZIP64 support). Member data is never touched.
+ */
+bool readZipMembers(std::istream& in, std::uint64_t fileSize, ArchiveBuilder& out) {
+    // End of central directory record: within the last 64 KB + 22 bytes
+    std::uint64_t tailSize = std::min<std::uint64_t>(fileSize, 65535 + 22);
+    std::vector<std::uint8_t> tail(tailSize);
+    in.seekg(static_cast<std::streamoff>(fileSize - tailSize));
+    in.read(reinterpret_cast<char*>(tail.data()), static_cast<std::streamsize>(tailSize));
+    if (!in || tailSize < 22) return false;
+
+    std::size_t eocd = std::string::npos;
+    for (std::size_t i = tailSize - 22 + 1; i-- > 0;) {
+        if (readLE<std::uint32_t>(&tail[i]) == 0x06054b50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == std::string::npos) return false;
+
+    std::uint64_t entries = readLE<std::uint16_t>(&tail[eocd + 10]);
+    std::uint64_t cdSize = readLE<std::uint32_t>(&tail[eocd + 12]);
+    std::uint64_t cdOffset = readLE<std::uint32_t>(&tail[eocd + 16]);
+
+    if ((entries == 0xFFFF || cdSize == 0xFFFFFFFF || cdOffset == 0xFFFFFFFF) && eocd >= 20 &&
+        readLE<std::uint32_t>(&tail[eocd - 20]) == 0x07064b50) {
+        // ZIP64: the real values live in the ZIP64 end record
+        std::uint64_t zip64At = readLE<std::uint64_t>(&tail[eocd - 20 + 8]);
+        std::uint8_t record[56];
+        in.seekg(static_cast<std::streamoff>(zip64At));
+        in.read(reinterpret_cast<char*>(record), sizeof(record));
+        if (!in || readLE<std::uint32_t>(record) != 0x06064b50) return false;
+        entries = readLE<std::uint64_t>(record + 32);
+        cdSize = readLE<std::uint64_t>(record + 40);
+        cdOffset = readLE<std::uint64_t>(record + 48);
+    }
+    if (cdOffset + cdSize > fileSize) return false;
+
+    std::vector<std::uint8_t> cd(cdSize);
+    in.seekg(static_cast<std::streamoff>(cdOffset));
+    in.read(reinterpret_cast<char*>(cd.data()), static_cast<std::streamsize>(cdSize));
+    if (!in) return false;
+
+    std::size_t pos = 0;
+    for (std::uint64_t e = 0; e < entries; ++e) {
+        if (pos + 46 > cd.size() || readLE<std::uint32_t>(&cd[pos]) != 0x02014b50) return false;
+        const std::uint8_t* h = &cd[pos];
+        std::uint16_t dosTime = readLE<std::uint16_t>(h + 12);
+        std::uint16_t dosDate = readLE<std::uint16_t>(h + 14);
+        std::uint64_t size = readLE<std::uint32_t>(h + 24);
+        std::uint64_t compressed = readLE<std::uint32_t>(h + 20);
+        std::size_t nameLength = readLE<std::uint16_t>(h + 28);
+        std::size_t extraLength = readLE<std::uint16_t>(h + 30);
+        std::size_t commentLength = readLE<std::uint16_t>(h + 32);
+        if (pos + 46 + nameLength + extraLength + commentLength > cd.size()) return false;
+
+        std::string name(reinterpret_cast<const char*>(h + 46), nameLength);
+
+        // ZIP64 extra field holds the sizes that didn't fit
+        const std::uint8_t* extra = h + 46 + nameLength;
+        for (std::size_t x = 0; x + 4 <= extraLength;) {
+            std::uint16_t id = readLE<std::uint16_t>(extra + x);
+            std::uint16_t length = readLE<std::uint16_t>(extra + x + 2);
+            if (id == 0x0001) {
+                std::size_t field = x + 4;
+                if (size == 0xFFFFFFFF && field + 8 <= x + 4 + length) {
+                    size = readLE<std::uint64_t>(extra + field);
+                    field += 8;
+                }
+                if (compressed == 0xFFFFFFFF && field + 8 <= x + 4 + length) {
+                    compressed = readLE<std::uint64_t>(extra + field);
+                }
+            }
+            x += 4 + length;
+        }
+
+        // DOS date/time, local time of the zipping machine (taken as UTC)
+        std::int64_t mtime = daysFromCivil(1980 + (dosDate >> 9), (dosDate >> 5) & 15, dosDate & 31) * 86400 +
+                             (dosTime >> 11) * 3600 + ((dosTime >> 5) & 63) * 60 + (dosTime & 31) * 2;
+
+        bool folder = !name.empty() && name.back() == '/';
+        out.addMember(name, folder ? 0 : size, mtime, 0, folder);
+        pos += 46 + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+/**
+ * Streaming DEFLATE decoder (RFC 1951) for .tar.gz, so no zlib is
+ * needed. Decoded bytes go to `sink` in chunks; the sink returns false
+ * once it has seen enough.
+ */
+class Inflater {
+public:
+    using Sink = std::function<bool(const std::uint8_t*, std::size_t)>;
+
+    Inflater(std::istream& in, Sink sink) : in(in), sink(std::move(sink)) {}
+
+    // Decodes every gzip member in the stream. False if it isn't valid gzip.
+    bool runGzip() {
+        try {
+            bool first = true;
+            while (true) {
+                int id1 = nextByte();
+                if (id1 < 0 && !first) break;
+                if (id1 != 0x1f || nextByte() != 0x8b || nextByte() != 8) {
+                    if (first) return false;
+                    break;          // trailing padding: what was inflated still counts
+                }
+                first = false;
+
+                int flags = nextByte();
+                for (int i = 0; i < 6; ++i) nextByte();           // mtime, xfl, os
+                if (flags & 4) {                                   // FEXTRA
+                    int length = nextByte();
+                    length |= nextByte() << 8;
+                    for (int i = 0; i < length; ++i) nextByte();
+                }
+                if (flags & 8) while (nextByte() > 0) {}           // FNAME
+                if (flags & 16) while (nextByte() > 0) {}          // FCOMMENT
+                if (flags & 2) { nextByte(); nextByte(); }         // FHCRC
+
+                inflate();
+                int drop = bitCount % 8;                           // back to byte boundary; whole
+                bitBuffer >>= drop;                                // bytes already buffered are
+                bitCount -= drop;                                  // read first by nextByte()
+                for (int i = 0; i < 8; ++i) nextByte();            // crc32, isize
+            }
+            flush();
+            return true;
+        } catch (const Stop&) {
+            return true;
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+    }
+
+private:
+    struct Stop {};
+
+    struct Huffman {
+        std::uint16_t count[16] = {};
+        std::uint16_t symbol[320] = {};
+        std::uint16_t fast[512] = {};       // symbol | length << 9, for codes up to 9 bits
+
+        void build(const std::uint8_t* lengths, int n) {
+            std::fill(std::begin(count), std::end(count), 0);
+            std::fill(std::begin(fast), std::end(fast), 0);
+            for (int s = 0; s < n; ++s) count[lengths[s]]++;
+            count[0] = 0;
+
+            std::uint16_t offsets[16] = {};
+            std::uint32_t nextCode[16] = {};
+            for (int len = 1; len < 16; ++len) {
+                offsets[len] = offsets[len - 1] + count[len - 1];
+                nextCode[len] = (nextCode[len - 1] + count[len - 1]) << 1;
+            }
+            for (int s = 0; s < n; ++s) {
+                int len = lengths[s];
+                if (len == 0) continue;
+                symbol[offsets[len]++] = static_cast<std::uint16_t>(s);
+
+                std::uint32_t code = nextCode[len]++;
+                if (len <= 9) {
+                    std::uint32_t reversed = 0;
+                    for (int b = 0; b < len; ++b) reversed |= ((code >> b) & 1) << (len - 1 - b);
+                    for (std::uint32_t k = reversed; k < 512; k += 1u << len) {
+                        fast[k] = static_cast<std::uint16_t>(s | (len << 9));
+                    }
+                }
+            }
+        }
+    };
+
+    std::istream& in;
+    Sink sink;
+    std::vector<std::uint8_t> input = std::vector<std::uint8_t>(1 << 16);
+    std::size_t inputPos = 0;
+    std::size_t inputLength = 0;
+    std::uint64_t bitBuffer = 0;
+    int bitCount = 0;
+
+    std::vector<std::uint8_t> window = std::vector<std::uint8_t>(1 << 15);
+    std::uint64_t produced = 0;
+    std::vector<std::uint8_t> pending;
+
+    int nextByte() {
+        if (bitCount >= 8) {
+            int b = static_cast<int>(bitBuffer & 0xFF);
+            bitBuffer >>= 8;
+            bitCount -= 8;
+            return b;
+        }
+        if (inputPos == inputLength) {
+            in.read(reinterpret_cast<char*>(input.data()), static_cast<std::streamsize>(input.size()));
+            inputLength = static_cast<std::size_t>(in.gcount());
+            inputPos = 0;
+            if (inputLength == 0) return -1;
+        }
+        return input[inputPos++];
+    }
+
+    // Tops the bit buffer up with whatever input is available
+    void fill() {
+        while (bitCount <= 56) {
+            if (inputPos == inputLength) {
+                in.read(reinterpret_cast<char*>(input.data()), static_cast<std::streamsize>(input.size()));
+                inputLength = static_cast<std::size_t>(in.gcount());
+                inputPos = 0;
+                if (inputLength == 0) return;
+            }
+            bitBuffer |= static_cast<std::uint64_t>(input[inputPos++]) << bitCount;
+            bitCount += 8;
+        }
+    }
+
+    std::uint32_t bits(int n) {
+        if (bitCount < n) fill();
+        if (bitCount < n) throw std::runtime_error("truncated deflate stream");
+        std::uint32_t value = static_cast<std::uint32_t>(bitBuffer & ((1ull << n) - 1));
+        bitBuffer >>= n;
+        bitCount -= n;
+        return value;
+    }
+
+    int decode(const Huffman& h) {
+        if (bitCount < 15) fill();
+        std::uint16_t entry = h.fast[bitBuffer & 511];
+        if (entry && (entry >> 9) <= bitCount) {
+            bitBuffer >>= entry >> 9;
+            bitCount -= entry >> 9;
+            return entry & 511;
+        }
+        // Longer code: walk the canonical code one bit at a time
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len < 16 && len <= bitCount; ++len) {
+            code |= static_cast<int>((bitBuffer >> (len - 1)) & 1);
+            int count = h.count[len];
+            if (code < first + count) {
+                bitBuffer >>= len;
+                bitCount -= len;
+                return h.symbol[index + code - first];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        throw std::runtime_error("bad huffman code");
+    }
+
+    void put(std::uint8_t b) {
+        window[produced & 0x7FFF] = b;
+        produced++;
+        pending.push_back(b);
+        if (pending.size() >= (1 << 16)) flush();
+    }
+
+    void flush() {
+        if (!pending.empty() && !sink(pending.data(), pending.size())) throw Stop();
+        pending.clear();
+    }
+
+    void inflate() {
+        static const std::uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                     35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const std::uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const std::uint16_t distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                                   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                                   8193, 12289, 16385, 24577};
+        static const std::uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        static const std::uint8_t lengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        Huffman literals, distances;
+        bool last = false;
+        while (!last) {
+            last = bits(1) != 0;
+            std::uint32_t type = bits(2);
+
+            if (type == 0) {
+                // Stored block
+                int drop = bitCount % 8;
+                bitBuffer >>= drop;
+                bitCount -= drop;
+                std::uint32_t length = bits(16);
+                if ((bits(16) ^ 0xFFFF) != length) throw std::runtime_error("bad stored block");
+                for (std::uint32_t i = 0; i < length; ++i) put(static_cast<std::uint8_t>(bits(8)));
+                continue;
+            }
+
+            std::uint8_t lengths[320] = {};
+            if (type == 1) {
+                for (int s = 0; s < 144; ++s) lengths[s] = 8;
+                for (int s = 144; s < 256; ++s) lengths[s] = 9;
+                for (int s = 256; s < 280; ++s) lengths[s] = 7;
+                for (int s = 280; s < 288; ++s) lengths[s] = 8;
+                literals.build(lengths, 288);
+                for (int s = 0; s < 30; ++s) lengths[s] = 5;
+                distances.build(lengths, 30);
+            } else if (type == 2) {
+                int nlen = static_cast<int>(bits(5)) + 257;
+                int ndist = static_cast<int>(bits(5)) + 1;
+                int ncode = static_cast<int>(bits(4)) + 4;
+                for (int i = 0; i < ncode; ++i) lengths[lengthOrder[i]] = static_cast<std::uint8_t>(bits(3));
+                Huffman lengthCode;
+                lengthCode.build(lengths, 19);
+
+                std::fill(std::begin(lengths), std::end(lengths), 0);
+                for (int i = 0; i < nlen + ndist;) {
+                    int sym = decode(lengthCode);
+                    if (sym < 16) {
+                        lengths[i++] = static_cast<std::uint8_t>(sym);
+                        continue;
+                    }
+                    std::uint8_t repeat = 0;
+                    int times;
+                    if (sym == 16) {
+                        if (i == 0) throw std::runtime_error("bad length repeat");
+                        repeat = lengths[i - 1];
+                        times = 3 + static_cast<int>(bits(2));
+                    } else if (sym == 17) {
+                        times = 3 + static_cast<int>(bits(3));
+                    } else {
+                        times = 11 + static_cast<int>(bits(7));
+                    }
+                    if (i + times > nlen + ndist) throw std::runtime_error("too many lengths");
+                    while (times--) lengths[i++] = repeat;
+                }
+                literals.build(lengths, nlen);
+                distances.build(lengths + nlen, ndist);
+            } else {
+                throw std::runtime_error("bad block type");
+            }
+
+            while (true) {
+                int sym = decode(literals);
+                if (sym < 256) {
+                    put(static_cast<std::uint8_t>(sym));
+                } else if (sym == 256) {
+                    break;
+                } else {
+                    sym -= 257;
+                    if (sym >= 29) throw std::runtime_error("bad length");
+                    std::uint32_t length = lengthBase[sym] + bits(lengthExtra[sym]);
+                    int dsym = decode(distances);
+                    if (dsym >= 30) throw std::runtime_error("bad distance");
+                    std::uint32_t distance = distBase[dsym] + bits(distExtra[dsym]);
+                    if (distance > produced) throw std::runtime_error("distance too far");
+                    for (std::uint32_t i = 0; i < length; ++i) {
+                        put(window[(produced - distance) & 0x7FFF]);
+                    }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * Parses tar headers (ustar, GNU long names, pax) for both plain tars,
+ * where bodies are skipped with seeks, and streamed .tar.gz.
+ */
+struct TarParser {
+    enum BodyAction { Skip, LongName, Pax };
+
+    // Long name and pax bodies are read into memory; bigger ones are skipped
+    static constexpr std::uint64_t MAX_META_SIZE = 1 << 20;
+
+    ArchiveBuilder& out;
+    std::string longName;         // GNU 'L' entry, names the next member
+    std::string paxPath;
+    std::uint64_t paxSize = 0;
+    bool hasPaxSize = false;
+    int zeroBlocks = 0;
+
+    explicit TarParser(ArchiveBuilder& out) : out(out) {}
+
+    static std::uint64_t number(const std::uint8_t* field, std::size_t length) {
+        std::uint64_t value = 0;
+        if (field[0] & 0x80) {
+            // GNU base-256 for values that don't fit in octal: big-endian,
+            // flag bit aside; negative values (0xFF...) mean nothing here
+            if (field[0] & 0x40) return 0;
+            value = field[0] & 0x3F;
+            for (std::size_t i = 1; i < length; ++i) value = (value << 8) | field[i];
+            return value;
+        }
+        for (std::size_t i = 0; i < length && field[i]; ++i) {
+            if (field[i] >= '0' && field[i] <= '7') value = value * 8 + (field[i] - '0');
+        }
+        return value;
+    }
+
+    // Returns false at the end-of-archive marker. Throws if it isn't a tar.
+    bool header(const std::uint8_t* block, std::uint64_t& bodySize, BodyAction& action) {
+        bodySize = 0;
+        action = Skip;
+        if (std::all_of(block, block + 512, [](std::uint8_t b) { return b == 0; })) {
+            return ++zeroBlocks < 2;
+        }
+        zeroBlocks = 0;
+
+        std::uint64_t sum = 0;
+        for (int i = 0; i < 512; ++i) sum += (i >= 148 && i < 156) ? ' ' : block[i];
+        if (sum != number(block + 148, 8)) throw std::runtime_error("bad tar checksum");
+
+        char type = static_cast<char>(block[156]);
+        bodySize = number(block + 124, 12);
+
+        std::string name(reinterpret_cast<const char*>(block), strnlen(reinterpret_cast<const char*>(block), 100));
+        if (std::memcmp(block + 257, "ustar", 5) == 0 && block[345]) {
+            name = std::string(reinterpret_cast<const char*>(block + 345),
+                               strnlen(reinterpret_cast<const char*>(block + 345), 155)) + "/" + name;
+        }
+
+        if (type == 'L' && bodySize <= MAX_META_SIZE) { action = LongName; return true; }
+        if (type == 'x' && bodySize <= MAX_META_SIZE) { action = Pax; return true; }
+        if (type == 'L' || type == 'x') { return true; }
+        if (type == 'g') { return true; }
+
+        if (!longName.empty()) name.swap(longName);
+        if (!paxPath.empty()) name.swap(paxPath);
+        longName.clear();
+        paxPath.clear();
+        std::uint64_t size = hasPaxSize ? paxSize : bodySize;
+        hasPaxSize = false;
+        bodySize = size;        // what the readers skip, too (pax size is for members over 8 GiB)
+
+        std::int64_t mtime = static_cast<std::int64_t>(number(block + 136, 12));
+        std::uint32_t uid = static_cast<std::uint32_t>(number(block + 108, 8));
+        if (type == '5') {
+            out.addMember(name, 0, mtime, uid, true);
+        } else if (type == '0' || type == '\0' || type == '7' || type == 'S') {
+            out.addMember(name, size, mtime, uid, false);
+        }
+        return true;
+    }
+
+    void body(BodyAction action, const std::string& data) {
+        if (action == LongName) {
+            longName.assign(data.c_str());
+        } else if (action == Pax) {
+            // Records look like "LEN key=value\n"
+            for (std::size_t pos = 0; pos < data.size();) {
+                std::size_t space = data.find(' ', pos);
+                if (space == std::string::npos) break;
+                std::size_t length = std::strtoull(data.c_str() + pos, nullptr, 10);
+                if (length == 0 || pos + length > data.size()) break;
+                std::string record = data.substr(space + 1, pos + length - space - 2);
+                std::size_t eq = record.find('=');
+                if (eq != std::string::npos) {
+                    std::string key = record.substr(0, eq);
+                    if (key == "path") paxPath = record.substr(eq + 1);
+                    if (key == "size") {
+                        paxSize = std::strtoull(record.c_str() + eq + 1, nullptr, 10);
+                        hasPaxSize = true;
+                    }
+                }
+                pos += length;
+            }
+        }
+    }
+};
+
+bool readTarMembers(std::istream& in, ArchiveBuilder& out) {
+    TarParser parser(out);
+    std::uint8_t block[512];
+    bool any = false;
+    while (in.read(reinterpret_cast<char*>(block), sizeof(block))) {
+        std::uint64_t bodySize;
+        TarParser::BodyAction action;
+        if (!parser.header(block, bodySize, action)) break;
+        any = true;
+
+        std::uint64_t padded = (bodySize + 511) / 512 * 512;
+        if (action == TarParser::Skip) {
+            in.seekg(static_cast<std::streamoff>(padded), std::ios::cur);
+        } else {
+            std::string data(bodySize, '\0');
+            in.read(&data[0], static_cast<std::streamsize>(bodySize));
+            in.seekg(static_cast<std::streamoff>(padded - bodySize), std::ios::cur);
+            parser.body(action, data);
+        }
+    }
+    return any;
+}
+
+bool readTarGzMembers(std::istream& in, ArchiveBuilder& out) {
+    TarParser parser(out);
+    std::uint8_t header[512];
+    std::size_t headerFill = 0;
+    std::uint64_t remaining = 0;           // body + padding still to pass over
+    std::uint64_t bodySize = 0;
+    TarParser::BodyAction action = TarParser::Skip;
+    std::string collected;
+
+    Inflater inflater(in, [&](const std::uint8_t* data, std::size_t length) {
+        while (length > 0) {
+            if (remaining > 0) {
+                std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, length));
+                if (action != TarParser::Skip && collected.size() < bodySize) {
+                    collected.append(reinterpret_cast<const char*>(data),
+                                     std::min<std::size_t>(take, bodySize - collected.size()));
+                }
+                data += take;
+                length -= take;
+                remaining -= take;
+                if (remaining == 0 && action != TarParser::Skip) parser.body(action, collected);
+                continue;
+            }
+
+            std::size_t take = std::min(length, sizeof(header) - headerFill);
+            std::memcpy(header + headerFill, data, take);
+            headerFill += take;
+            data += take;
+            length -= take;
+            if (headerFill < sizeof(header)) break;
+
+            headerFill = 0;
+            // Past the end-of-archive zeros, like tar -i: another gzip
+            // member may follow (cat one.tgz two.tgz)
+            parser.header(header, bodySize, action);
+            remaining = (bodySize + 511) / 512 * 512;
+            collected.clear();
+            if (remaining == 0 && action != TarParser::Skip) parser.body(action, collected);
+        }
+        return true;
+    });
+    return inflater.runGzip();
+}
+
+/**
+ * Reads an archive's member list into a tree rooted at the archive.
+ * Returns nullptr if the file isn't a readable archive.
+ */
+std::unique_ptr<ScanTree> readArchive(const std::string& name, const fs::path& path, const EntryInfo& info) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return nullptr;
+
+    ArchiveBuilder builder;
+    EntryInfo rootInfo = info;
+    rootInfo.size = 0;
+    builder.tree.addNode(NO_NODE, name, rootInfo, true);
+
+    std::string lower = lowerCase(name);
+    bool ok = false;
+    try {
+        if (endsWith(lower, ".zip") || endsWith(lower, ".jar")) {
+            ok = readZipMembers(in, info.size, builder);
+        } else if (endsWith(lower, ".tar")) {
+            ok = readTarMembers(in, builder);
+        } else {
+            ok = readTarGzMembers(in, builder);
+        }
+    } catch (const std::exception&) {
+        ok = false;
+    }
+    if (!ok) return nullptr;
+
+    builder.finish();
+    return std::make_unique<ScanTree>(std::move(builder.tree));
+}
+
+/**
+ * Replaces the archives found while scanning with folders of their
+ * members. Archives are read in parallel; each archive folder keeps the
+ * archive's real allocation, members count only toward size.
+ */
+void expandArchives(ScanTree& tree) {
+    std::vector<ArchiveJob> jobs;
+    jobs.swap(tree.archives);
+    if (jobs.empty()) return;
+
+    std::vector<std::unique_ptr<ScanTree>> results(jobs.size());
+    std::atomic<std::size_t> next{0};
+    std::size_t workers = std::min<std::size_t>(jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<void>> pool;
+    for (std::size_t w = 0; w < workers; ++w) {
+        pool.push_back(std::async(std::launch::async, [&]() {
+            for (std::size_t j; (j = next++) < jobs.size();) {
+                results[j] = readArchive(jobs[j].name, jobs[j].path, jobs[j].info);
+            }
+        }));
+    }
+    for (auto& worker : pool) worker.get();
+
+    for (std::size_t j = 0; j < jobs.size(); ++j) {
+        const ArchiveJob& job = jobs[j];
+        std::uintmax_t addedSize = job.info.size;
+        if (results[j]) {
+            appendSubtree(tree, job.folder, *results[j]);
+            addedSize = results[j]->size[0];
+        } else {
+            // Not readable as an archive - keep it as a plain file
+            tree.addNode(job.folder, job.name, job.info, false);
+            tree.size[job.folder] += job.info.size;
+            tree.alloc[job.folder] += job.info.alloc;
+        }
+        for (std::uint32_t p = tree.parent[job.folder]; p != NO_NODE; p = tree.parent[p]) {
+            tree.size[p] += addedSize;
+            tree.alloc[p] += job.info.alloc;
+        }
+    }
+}
+
+// ============================================================================
+// HTML REPORT
+// ============================================================================
+
+// A chunk file stops growing once it passes this many bytes of JSON
+const std::size_t HTML_CHUNK_BYTES = 256 * 1024;
+// Subtrees smaller than this are embedded in their parent's chunk
+const std::size_t HTML_INLINE_BYTES = 16 * 1024;
+// Rough JSON cost of one entry besides its name
+const std::size_t HTML_ENTRY_BYTES = 40;
+
+/**
+ * Writes a node and (for folders) its whole subtree as nested JSON
+ */
+void appendInlineNode(std::string& out, const ScanTree& tree, std::uint32_t node) {
+    out += "{\"n\":";
+    appendJsonString(out, tree.name(node));
+    out += ",\"s\":" + std::to_string(tree.size[node]);
+    if (tree.timedOut[node]) out += ",\"t\":1";
+    if (tree.isFolder[node]) {
+        out += ",\"d\":1,\"k\":[";
+        bool first = true;
+        for (std::uint32_t c : sortedChildren(tree, node)) {
+            if (!first) out += ',';
+            first = false;
+            appendInlineNode(out, tree, c);
+        }
+        out += ']';
+    }
+    out += '}';
+}
+
+const char* HTML_REPORT_PAGE = R"HTML(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>DiskScope report</title>
+<style>
+body { font: 14px/1.4 Consolas, Menlo, monospace; margin: 20px; background: #fafafa; color: #222; }
+h1 { font-size: 18px; margin: 0 0 4px; }
+#meta { color: #666; margin-bottom: 12px; }
+ul { list-style: none; margin: 0; padding-left: 18px; }
+#tree > ul { padding-left: 0; }
+.row { display: flex; gap: 8px; padding: 1px 4px; white-space: nowrap; }
+.row.dir { cursor: pointer; }
+.row:hover { background: #e8eef8; }
+.twist { width: 12px; color: #888; }
+.size { width: 90px; text-align: right; }
+.bar { width: 120px; height: 10px; margin-top: 5px; background: #e4e4e4; }
+.bar i { display: block; height: 100%; background: #4a7fd4; }
+.more, .note { color: #4a7fd4; cursor: pointer; padding: 1px 4px 1px 24px; }
+.note { color: #888; cursor: default; }
+</style>
+</head>
+<body>
+<h1>DiskScope report</h1>
+<div id="meta"></div>
+<div id="tree"></div>
+<script>
+var pending = {};
+
+// Every chunk file is a single call to this function
+function diskscopeChunk(id, kids) {
+  var done = pending[id];
+  delete pending[id];
+  if (done) done(kids);
+}
+
+// Script tags (unlike fetch) also work when the page is opened from disk
+function loadChunk(id, done) {
+  pending[id] = done;
+  var s = document.createElement('script');
+  s.src = 'chunks/c' + id + '.js';
+  s.onload = function () { s.remove(); };
+  s.onerror = function () { delete pending[id]; alert('Could not load chunks/c' + id + '.js'); };
+  document.head.appendChild(s);
+}
+
+function formatSize(bytes) {
+  var units = ['B', 'KB', 'MB', 'GB', 'TB'], i = 0, size = bytes;
+  while (size >= 1024 && i < units.length - 1) { size /= 1024; i++; }
+  return size.toFixed(2) + ' ' + units[i];
+}
+
+function note(list, text) {
+  var li = document.createElement('li');
+  li.className = 'note';
+  li.textContent = text;
+  list.appendChild(li);
+  return li;
+}
+
+function addRows(list, kids, parentSize) {
+  if (!kids.length && !list.firstChild) note(list, '(empty)');
+  kids.forEach(function (k) {
+    if (k.more !== undefined) {
+      var li = note(list, '... more');
+      li.className = 'more';
+      li.onclick = function () {
+        li.onclick = null;
+        li.textContent = 'loading...';
+        loadChunk(k.more, function (rest) { li.remove(); addRows(list, rest, parentSize); });
+      };
+      return;
+    }
+    list.appendChild(makeRow(k, parentSize));
+  });
+}
+
+function makeRow(node, parentSize) {
+  var li = document.createElement('li');
+  var line = document.createElement('div');
+  line.className = node.d ? 'row dir' : 'row';
+  line.innerHTML = '<span class="twist"></span><span class="size"></span>' +
+                   '<span class="bar"><i></i></span><span class="name"></span>';
+  var twist = line.querySelector('.twist');
+  twist.textContent = node.d ? '▸' : '';
+  line.querySelector('.size').textContent = formatSize(node.s);
+  line.querySelector('.bar i').style.width = (parentSize ? node.s * 100 / parentSize : 0).toFixed(1) + '%';
+  line.querySelector('.name').textContent = node.n + (node.t ? '  (timed out, partial)' : '');
+  li.appendChild(line);
+
+  if (node.d) {
+    var list = null;
+    line.onclick = function () {
+      if (list) {
+        list.hidden = !list.hidden;
+        twist.textContent = list.hidden ? '▸' : '▾';
+        return;
+      }
+      list = document.createElement('ul');
+      li.appendChild(list);
+      twist.textContent = '▾';
+      if (node.k) {
+        addRows(list, node.k, node.s);
+      } else {
+        var wait = note(list, 'loading...');
+        loadChunk(node.c, function (kids) { wait.remove(); addRows(list, kids, node.s); });
+      }
+    };
+  }
+  return li;
+}
+
+document.getElementById('meta').textContent =
+  REPORT.entries + ' entries, scanned ' + REPORT.scanned;
+var rootList = document.createElement('ul');
+document.getElementById('tree').appendChild(rootList);
+var root = makeRow({ n: REPORT.name, s: REPORT.size, d: 1, c: 0 }, REPORT.size);
+rootList.appendChild(root);
+root.firstChild.onclick();
+</script>
+</body>
+</html>
+)HTML";
+
+/**
+ * Writes outDir/index.html plus outDir/chunks/c<N>.js. Each chunk holds one
+ * page of a folder's children; small subtrees are embedded, large ones point
+ * at their own chunk, so the browser only loads what the viewer expands.
+ */
+bool writeHtmlReport(const ScanTree& tree, const fs::path& outDir) {
+    std::error_code ec;
+    fs::create_directories(outDir / "chunks", ec);
+    if (ec) {
+        std::cerr << "Error: Cannot create " << outDir << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    // Estimated JSON size of every subtree (children always come after parents)
+    std::vector<std::uint64_t> subtreeBytes(tree.count());
+    for (std::uint32_t i = tree.count(); i-- > 0;) {
+        subtreeBytes[i] += tree.name(i).size() + HTML_ENTRY_BYTES;
+        if (tree.parent[i] != NO_NODE) {
+            subtreeBytes[tree.parent[i]] += subtreeBytes[i];
+        }
+    }
+
+    // One job per chunk: list the children of `folder` starting at `first`
+    struct ChunkJob {
+        std::uint32_t folder;
+        std::size_t first;
+    };
+    std::vector<ChunkJob> jobs{{0, 0}};
+    std::map<std::uint32_t, std::vector<std::uint32_t>> pagedFolders;
+
+    for (std::size_t id = 0; id < jobs.size(); ++id) {
+        ChunkJob job = jobs[id];
+
+        std::vector<std::uint32_t> kids;
+        auto paged = pagedFolders.find(job.folder);
+        if (paged != pagedFolders.end()) {
+            kids = std::move(paged->second);
+            pagedFolders.erase(paged);
+        } else {
+            kids = sortedChildren(tree, job.folder);
+        }
+
+        std::string out = "diskscopeChunk(" + std::to_string(id) + ",[";
+        std::size_t used = 0;
+        std::size_t pos = job.first;
+
+        for (; pos < kids.size(); ++pos) {
+            std::uint32_t c = kids[pos];
+            std::size_t stubBytes = tree.name(c).size() + HTML_ENTRY_BYTES;
+            if (pos > job.first && used + stubBytes > HTML_CHUNK_BYTES) {
+                break;
+            }
+            if (pos > job.first) out += ',';
+
+            if (!tree.isFolder[c] ||
+                (subtreeBytes[c] <= HTML_INLINE_BYTES && used + subtreeBytes[c] <= HTML_CHUNK_BYTES)) {
+                appendInlineNode(out, tree, c);
+                used += subtreeBytes[c];
+            } else {
+                // Too big to embed - give it its own chunk
+                out += "{\"n\":";
+                appendJsonString(out, tree.name(c));
+                out += ",\"s\":" + std::to_string(tree.size[c]);
+                if (tree.timedOut[c]) out += ",\"t\":1";
+                out += ",\"d\":1,\"c\":" + std::to_string(jobs.size()) + "}";
+                jobs.push_back({c, 0});
+                used += stubBytes;
+            }
+        }
+
+        if (pos < kids.size()) {
+            // Rest of this folder goes to a follow-up page
+            out += ",{\"more\":" + std::to_string(jobs.size()) + "}";
+            jobs.push_back({job.folder, pos});
+            pagedFolders[job.folder] = std::move(kids);
+        }
+        out += "]);\n";
+
+        std::ofstream chunk(outDir / "chunks" / ("c" + std::to_string(id) + ".js"), std::ios::binary);
+        chunk << out;
+        if (!chunk) {
+            std::cerr << "Error: Cannot write chunk " << id << " in " << outDir << "\n";
+            return false;
+        }
+    }
+
+    // Page with the root summary inlined
+    char scanned[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(scanned, sizeof(scanned), "%Y-%m-%d %H:%M", std::localtime(&now));
+
+    std::string report = "<script>var REPORT = {\"name\":";
+    appendJsonString(report, tree.name(0));
+    report += ",\"size\":" + std::to_string(tree.size[0]);
+    report += ",\"entries\":" + std::to_string(tree.count());
+    report += ",\"scanned\":\"" + std::string(scanned) + "\"};</script>\n";
+
+    std::string page = HTML_REPORT_PAGE;
+    page.insert(page.find("<script>"), report);
+
+    std::ofstream index(outDir / "index.html", std::ios::binary);
+    index << page;
+    if (!index) {
+        std::cerr << "Error: Cannot write " << (outDir / "index.html") << "\n";
+        return false;
+    }
+
+    std::cout << "  Wrote " << jobs.size() << " chunks to " << outDir.string() << "\n";
+    return true;
+}
+
+// ============================================================================
+// ARROW EXPORT
+// ============================================================================
+
+/**
+ * Just enough of a FlatBuffers writer for Arrow's metadata. Objects are
+ * described as a small tree, then laid out front to back so that every
+ * offset points forward to a child written after its parent.
+ */
+struct FbObject {
+    enum Kind { Table, Vector, String, Structs } kind = Table;
+
+    struct Field {
+        int id;
+        std::vector<std::uint8_t> bytes;   // inline scalar (empty if child is set)
+        std::shared_ptr<FbObject> child;
+    };
+    std::vector<Field> fields;                      // Table
+    std::vector<std::shared_ptr<FbObject>> items;   // Vector of tables
+    std::string raw;                                // String text or packed structs
+    std::uint32_t structCount = 0;
+};
+
+using FbRef = std::shared_ptr<FbObject>;
+
+FbRef fbTable() {
+    return std::make_shared<FbObject>();
+}
+
+template <typename T>
+void fbScalar(const FbRef& table, int id, T value) {
+    FbObject::Field field{id, std::vector<std::uint8_t>(sizeof(T)), nullptr};
+    std::memcpy(field.bytes.data(), &value, sizeof(T));
+    table->fields.push_back(std::move(field));
+}
+
+void fbChild(const FbRef& table, int id, FbRef child) {
+    table->fields.push_back({id, {}, std::move(child)});
+}
+
+FbRef fbString(std::string_view text) {
+    auto obj = std::make_shared<FbObject>();
+    obj->kind = FbObject::String;
+    obj->raw.assign(text.data(), text.size());
+    return obj;
+}
+
+FbRef fbVector(std::vector<FbRef> items) {
+    auto obj = std::make_shared<FbObject>();
+    obj->kind = FbObject::Vector;
+    obj->items = std::move(items);
+    return obj;
+}
+
+// Arrow's structs (FieldNode, Buffer, Block) are all 8-byte aligned
+FbRef fbStructs(std::string packed, std::uint32_t count) {
+    auto obj = std::make_shared<FbObject>();
+    obj->kind = FbObject::Structs;
+    obj->raw = std::move(packed);
+    obj->structCount = count;
+    return obj;
+}
+
+struct FbWriter {
+    std::vector<std::uint8_t> buf;
+
+    void align(std::size_t a) {
+        while (buf.size() % a) buf.push_back(0);
+    }
+
+    template <typename T>
+    void put(T value) {
+        std::size_t at = buf.size();
+        buf.resize(at + sizeof(T));
+        std::memcpy(&buf[at], &value, sizeof(T));
+    }
+
+    template <typename T>
+    void patch(std::size_t at, T value) {
+        std::memcpy(&buf[at], &value, sizeof(T));
+    }
+
+    // Writes obj and everything below it, returns where obj starts
+    std::size_t write(const FbObject& obj) {
+        std::vector<std::pair<std::size_t, const FbObject*>> pending;
+        std::size_t start = 0;
+
+        if (obj.kind == FbObject::Table) {
+            // vtable: its size, table size, then one slot per field id
+            int maxId = -1;
+            for (const auto& f : obj.fields) maxId = std::max(maxId, f.id);
+            std::vector<std::uint16_t> slots(maxId + 1, 0);
+
+            // Place wide fields first so they stay aligned
+            std::vector<const FbObject::Field*> order;
+            for (const auto& f : obj.fields) order.push_back(&f);
+            std::stable_sort(order.begin(), order.end(), [](const FbObject::Field* a, const FbObject::Field* b) {
+                return (a->child ? 4 : a->bytes.size()) > (b->child ? 4 : b->bytes.size());
+            });
+            std::uint16_t tableSize = 4;
+            std::vector<std::uint16_t> at;
+            for (const auto* f : order) {
+                std::size_t width = f->child ? 4 : f->bytes.size();
+                while (tableSize % width) tableSize++;
+                at.push_back(tableSize);
+                slots[f->id] = tableSize;
+                tableSize += static_cast<std::uint16_t>(width);
+            }
+
+            align(2);
+            std::size_t vtable = buf.size();
+            put<std::uint16_t>(static_cast<std::uint16_t>(4 + 2 * slots.size()));
+            put<std::uint16_t>(tableSize);
+            for (auto s : slots) put<std::uint16_t>(s);
+
+            align(8);
+            start = buf.size();
+            put<std::int32_t>(static_cast<std::int32_t>(start - vtable));
+            for (std::size_t i = 0; i < order.size(); ++i) {
+                while (buf.size() < start + at[i]) buf.push_back(0);
+                if (order[i]->child) {
+                    pending.push_back({buf.size(), order[i]->child.get()});
+                    put<std::uint32_t>(0);
+                } else {
+                    buf.insert(buf.end(), order[i]->bytes.begin(), order[i]->bytes.end());
+                }
+            }
+            while (buf.size() < start + tableSize) buf.push_back(0);
+        }
+        else if (obj.kind == FbObject::Vector) {
+            align(4);
+            start = buf.size();
+            put<std::uint32_t>(static_cast<std::uint32_t>(obj.items.size()));
+            for (const auto& item : obj.items) {
+                pending.push_back({buf.size(), item.get()});
+                put<std::uint32_t>(0);
+            }
+        }
+        else if (obj.kind == FbObject::String) {
+            align(4);
+            start = buf.size();
+            put<std::uint32_t>(static_cast<std::uint32_t>(obj.raw.size()));
+            buf.insert(buf.end(), obj.raw.begin(), obj.raw.end());
+            buf.push_back(0);
+        }
+        else {
+            // Length prefix sits right before 8-byte aligned elements
+            align(4);
+            if (buf.size() % 8 == 0) put<std::uint32_t>(0);
+            start = buf.size();
+            put<std::uint32_t>(obj.structCount);
+            buf.insert(buf.end(), obj.raw.begin(), obj.raw.end());
+        }
+
+        for (const auto& p : pending) {
+            std::size_t child = write(*p.second);
+            patch<std::uint32_t>(p.first, static_cast<std::uint32_t>(child - p.first));
+        }
+        return start;
+    }
+
+    // Root offset, then the tree; padded so 8 + size is a multiple of 8
+    std::vector<std::uint8_t> finish(const FbObject& root) {
+        put<std::uint32_t>(0);
+        std::size_t rootAt = write(root);
+        patch<std::uint32_t>(0, static_cast<std::uint32_t>(rootAt));
+        align(8);
+        return std::move(buf);
+    }
+};
+
+template <typename T>
+void appendPod(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Arrow enum values used below
+const std::uint8_t ARROW_TYPE_INT = 2;
+const std::uint8_t ARROW_TYPE_UTF8 = 5;
+const std::uint8_t ARROW_TYPE_TIMESTAMP = 10;
+const std::uint8_t ARROW_HEADER_SCHEMA = 1;
+const std::uint8_t ARROW_HEADER_RECORD_BATCH = 3;
+const std::int16_t ARROW_METADATA_V5 = 4;
+
+// Rows per record batch
+const std::uint32_t ARROW_BATCH_ROWS = 1u << 20;
+
+FbRef arrowIntField(const char* name, int bits, bool isSigned, bool nullable) {
+    FbRef type = fbTable();
+    fbScalar<std::int32_t>(type, 0, bits);
+    fbScalar<std::uint8_t>(type, 1, isSigned ? 1 : 0);
+
+    FbRef field = fbTable();
+    fbChild(field, 0, fbString(name));
+    fbScalar<std::uint8_t>(field, 1, nullable ? 1 : 0);
+    fbScalar<std::uint8_t>(field, 2, ARROW_TYPE_INT);
+    fbChild(field, 3, type);
+    fbChild(field, 5, fbVector({}));
+    return field;
+}
+
+FbRef arrowSchema() {
+    FbRef name = fbTable();
+    fbChild(name, 0, fbString("name"));
+    fbScalar<std::uint8_t>(name, 1, 0);
+    fbScalar<std::uint8_t>(name, 2, ARROW_TYPE_UTF8);
+    fbChild(name, 3, fbTable());
+    fbChild(name, 5, fbVector({}));
+
+    FbRef secondsUtc = fbTable();
+    fbScalar<std::int16_t>(secondsUtc, 0, 0);
+    fbChild(secondsUtc, 1, fbString("UTC"));
+    FbRef mtime = fbTable();
+    fbChild(mtime, 0, fbString("mtime"));
+    fbScalar<std::uint8_t>(mtime, 1, 0);
+    fbScalar<std::uint8_t>(mtime, 2, ARROW_TYPE_TIMESTAMP);
+    fbChild(mtime, 3, secondsUtc);
+    fbChild(mtime, 5, fbVector({}));
+
+    FbRef schema = fbTable();
+    fbScalar<std::int16_t>(schema, 0, 0);  // little endian
+    fbChild(schema, 1, fbVector({
+        arrowIntField("id", 32, false, false),
+        arrowIntField("parent_id", 32, false, true),
+        name,
+        arrowIntField("type", 8, false, false),
+        arrowIntField("size", 64, false, false),
+        arrowIntField("alloc", 64, false, false),
+        mtime,
+        arrowIntField("uid", 32, false, false),
+    }));
+    return schema;
+}
+
+std::vector<std::uint8_t> arrowMessage(std::uint8_t headerType, FbRef header, std::int64_t bodyLength) {
+    FbRef message = fbTable();
+    fbScalar<std::int16_t>(message, 0, ARROW_METADATA_V5);
+    fbScalar<std::uint8_t>(message, 1, headerType);
+    fbChild(message, 2, header);
+    fbScalar<std::int64_t>(message, 3, bodyLength);
+    return FbWriter().finish(*message);
+}
+
+/**
+ * Writes the tree as an Arrow IPC file: one row per entry with columns
+ * id, parent_id (null for the root), name, type (0 = file, 1 = folder),
+ * size, alloc, mtime and uid. Column buffers are copied straight out of
+ * the tree's arrays, 64-byte aligned so readers can mmap them.
+ */
+bool writeArrowFile(const ScanTree& tree, const fs::path& outFile) {
+    std::ofstream out(outFile, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error: Cannot create " << outFile << "\n";
+        return false;
+    }
+
+    std::uint64_t pos = 0;
+    auto write = [&](const void* data, std::size_t len) {
+        out.write(static_cast<const char*>(data), static_cast<std::streamsize>(len));
+        pos += len;
+    };
+    auto pad = [&](std::size_t a) {
+        static const char zeros[64] = {};
+        write(zeros, (a - pos % a) % a);
+    };
+
+    // Each message: continuation marker, metadata length, metadata padded
+    // so the body that follows starts 64-byte aligned
+    auto writeMessage = [&](const std::vector<std::uint8_t>& meta) {
+        std::uint32_t marker = 0xFFFFFFFFu;
+        std::int32_t metaLength = static_cast<std::int32_t>((pos + 8 + meta.size() + 63) / 64 * 64 - pos - 8);
+        write(&marker, 4);
+        write(&metaLength, 4);
+        write(meta.data(), meta.size());
+        pad(64);
+        return 8 + metaLength;
+    };
+
+    write("ARROW1\0\0", 8);
+    writeMessage(arrowMessage(ARROW_HEADER_SCHEMA, arrowSchema(), 0));
+
+    std::string blocks;
+    std::uint32_t blockCount = 0;
+    const std::uint32_t total = tree.count();
+
+    for (std::uint32_t first = 0; first < total;) {
+        // Cut the batch early if names would overflow 32-bit offsets
+        std::uint32_t last = std::min(total, first + ARROW_BATCH_ROWS);
+        while (last - first > 1 && tree.nameStart[last] - tree.nameStart[first] > 0x7FFFFFFFu) {
+            last = first + (last - first) / 2;
+        }
+        const std::uint32_t rows = last - first;
+
+        std::vector<std::uint32_t> ids(rows);
+        std::vector<std::int32_t> nameOffsets(rows + 1);
+        std::string parentValid;
+        std::int64_t parentNulls = 0;
+        for (std::uint32_t i = 0; i < rows; ++i) {
+            ids[i] = first + i;
+            nameOffsets[i] = static_cast<std::int32_t>(tree.nameStart[first + i] - tree.nameStart[first]);
+            if (tree.parent[first + i] == NO_NODE) parentNulls++;
+        }
+        nameOffsets[rows] = static_cast<std::int32_t>(tree.nameStart[last] - tree.nameStart[first]);
+        if (parentNulls) {
+            parentValid.assign((rows + 7) / 8, '\0');
+            for (std::uint32_t i = 0; i < rows; ++i) {
+                if (tree.parent[first + i] != NO_NODE) parentValid[i / 8] |= static_cast<char>(1 << (i % 8));
+            }
+        }
+
+        // Buffers in schema order: validity then data (plus offsets for names)
+        struct Buffer { const void* data; std::size_t len; };
+        std::vector<Buffer> buffers = {
+            {nullptr, 0}, {ids.data(), rows * 4},
+            {parentValid.data(), parentValid.size()}, {&tree.parent[first], rows * 4},
+            {nullptr, 0}, {nameOffsets.data(), (rows + 1) * 4},
+            {tree.namePool.data() + tree.nameStart[first], static_cast<std::size_t>(nameOffsets[rows])},
+            {nullptr, 0}, {&tree.isFolder[first], rows * 1},
+            {nullptr, 0}, {&tree.size[first], rows * 8},
+            {nullptr, 0}, {&tree.alloc[first], rows * 8},
+            {nullptr, 0}, {&tree.mtime[first], rows * 8},
+            {nullptr, 0}, {&tree.uid[first], rows * 4},
+        };
+
+        std::string layout;
+        std::uint64_t bodyLength = 0;
+        for (const auto& b : buffers) {
+            appendPod<std::int64_t>(layout, static_cast<std::int64_t>(bodyLength));
+            appendPod<std::int64_t>(layout, static_cast<std::int64_t>(b.len));
+            bodyLength += (b.len + 63) / 64 * 64;
+        }
+
+        std::string nodes;
+        for (int column = 0; column < 8; ++column) {
+            appendPod<std::int64_t>(nodes, rows);
+            appendPod<std::int64_t>(nodes, column == 1 ? parentNulls : 0);
+        }
+
+        FbRef batch = fbTable();
+        fbScalar<std::int64_t>(batch, 0, rows);
+        fbChild(batch, 1, fbStructs(nodes, 8));
+        fbChild(batch, 2, fbStructs(layout, static_cast<std::uint32_t>(buffers.size())));
+
+        std::uint64_t offset = pos;
+        std::int32_t metaLength = writeMessage(arrowMessage(ARROW_HEADER_RECORD_BATCH, batch,
+                                                            static_cast<std::int64_t>(bodyLength)));
+
+        std::uint64_t bodyStart = pos;
+        for (const auto& b : buffers) {
+            write(b.data, b.len);
+            pad(64);
+        }
+
+        appendPod<std::int64_t>(blocks, static_cast<std::int64_t>(offset));
+        appendPod<std::int32_t>(blocks, metaLength);
+        appendPod<std::int32_t>(blocks, 0);
+        appendPod<std::int64_t>(blocks, static_cast<std::int64_t>(pos - bodyStart));
+        blockCount++;
+
+        first = last;
+    }
+
+    // End-of-stream marker, then the footer that indexes the batches
+    std::uint32_t eos[2] = {0xFFFFFFFFu, 0};
+    write(eos, 8);
+
+    FbRef footer = fbTable();
+    fbScalar<std::int16_t>(footer, 0, ARROW_METADATA_V5);
+    fbChild(footer, 1, arrowSchema());
+    fbChild(footer, 3, fbStructs(blocks, blockCount));
+    std::vector<std::uint8_t> footerBytes = FbWriter().finish(*footer);
+    std::int32_t footerLength = static_cast<std::int32_t>(footerBytes.size());
+    write(footerBytes.data(), footerBytes.size());
+    write(&footerLength, 4);
+    write("ARROW1", 6);
+
+    if (!out) {
+        std::cerr << "Error: Cannot write " << outFile << "\n";
+        return false;
+    }
+    std::cout << "  Wrote " << total << " rows in " << blockCount << " batches to " << outFile.string() << "\n";
+    return true;
+}
+
+// ============================================================================
+// FOLDED STACKS (flamegraph.pl / speedscope export)
+// ============================================================================
+
+// Subtrees smaller than this are folded into their parent's line (--folded-min)
+std::uint64_t foldedMinSize = 1024 * 1024;
+// Output is written in pieces of about this size
+const std::size_t FOLDED_FLUSH_BYTES = 1 << 20;
+
+/**
+ * Writes one "root;dir;subdir BYTES" line per folder, weighted by the
+ * bytes of its own files plus any pruned subfolders, as flamegraph.pl
+ * and speedscope read it. One preorder walk with a single stack buffer:
+ * entering a folder appends its name, leaving it cuts the buffer back,
+ * so no path strings are kept.
+ */
+bool writeFoldedStacks(const ScanTree& tree, const fs::path& outFile) {
+    std::ofstream out(outFile, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error: Cannot create " << outFile << "\n";
+        return false;
+    }
+
+    std::string stack;                                          // current folder's frames
+    std::vector<std::pair<std::uint32_t, std::size_t>> open;    // folder, stack length before it
+    std::string buffer;
+    buffer.reserve(FOLDED_FLUSH_BYTES + 4096);
+    std::uint64_t lines = 0;
+
+    for (std::uint32_t i = 0; i < tree.count();) {
+        if (!tree.isFolder[i]) {
+            ++i;            // counted in its folder's line
+            continue;
+        }
+        if (i > 0 && tree.size[i] < foldedMinSize) {
+            i = tree.subtreeEnd[i];     // counted in its parent's line
+            continue;
+        }
+        while (!open.empty() && tree.subtreeEnd[open.back().first] <= i) {
+            stack.resize(open.back().second);
+            open.pop_back();
+        }
+        open.push_back({i, stack.size()});
+        if (!stack.empty()) stack += ';';
+        for (char c : tree.name(i)) {
+            // The separators of the format can't appear inside a frame
+            stack += c == ';' || c == '\n' || c == '\r' ? '_' : c;
+        }
+
+        // Own weight: everything that isn't a subfolder big enough for its own line
+        std::uintmax_t own = tree.size[i];
+        for (std::uint32_t c = i + 1; c < tree.subtreeEnd[i]; c = tree.subtreeEnd[c]) {
+            if (tree.isFolder[c] && tree.size[c] >= foldedMinSize) own -= tree.size[c];
+        }
+        if (own > 0) {
+            char digits[24];
+            char* end = std::to_chars(digits, digits + sizeof(digits), own).ptr;
+            buffer += stack;
+            buffer += ' ';
+            buffer.append(digits, end);
+            buffer += '\n';
+            lines++;
+            if (buffer.size() >= FOLDED_FLUSH_BYTES) {
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        ++i;
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    if (!out) {
+        std::cerr << "Error: Cannot write " << outFile << "\n";
+        return false;
+    }
+    std::cout << "  Wrote " << lines << " folded stacks to " << outFile.string() << "\n";
+    return true;
+}
+
+// ============================================================================
+// SNAPSHOTS
+// ============================================================================
+
+// File layout: magic, header, then each column of the finalized tree as
+// one raw little-endian array, so loading is a handful of bulk reads.
+// Version 2 stores each repeated subtree once: the columns hold only the
+// kept nodes, and a reference table says where to copy the others from.
+const char SNAPSHOT_MAGIC[8] = {'D', 'S', 'S', 'N', 'A', 'P', '0', '2'};
+const char SNAPSHOT_MAGIC_V1[8] = {'D', 'S', 'S', 'N', 'A', 'P', '0', '1'};
+
+template <typename T>
+void writeColumn(std::ofstream& out, const std::vector<T>& column) {
+    out.write(reinterpret_cast<const char*>(column.data()),
+              static_cast<std::streamsize>(column.size() * sizeof(T)));
+}
+
+template <typename T>
+bool readColumn(std::ifstream& in, std::vector<T>& column, std::size_t count) {
+    column.resize(count);
+    in.read(reinterpret_cast<char*>(column.data()), static_cast<std::streamsize>(count * sizeof(T)));
+    return static_cast<bool>(in);
+}
+
+/**
+ * Hash-conses the subtrees of a finalized tree: two nodes get the same
+ * id exactly when their names, columns and children (recursively) match.
+ */
+std::vector<std::uint32_t> subtreeIds(const ScanTree& tree) {
+    std::vector<std::uint32_t> ids(tree.count());
+    std::unordered_map<std::string, std::uint32_t> known;
+    std::string key;
+    // Children come after their parent, so walk backwards
+    for (std::uint32_t i = tree.count(); i-- > 0;) {
+        key.clear();
+        std::string_view name = tree.name(i);
+        appendPod(key, static_cast<std::uint32_t>(name.size()));
+        key.append(name.data(), name.size());
+        appendPod(key, tree.size[i]);
+        appendPod(key, tree.alloc[i]);
+        appendPod(key, tree.mtime[i]);
+        appendPod(key, tree.uid[i]);
+        appendPod(key, tree.isFolder[i]);
+        appendPod(key, tree.timedOut[i]);
+        for (std::uint32_t c = i + 1; c < tree.subtreeEnd[i]; c = tree.subtreeEnd[c]) {
+            appendPod(key, ids[c]);
+        }
+        ids[i] = known.emplace(key, static_cast<std::uint32_t>(known.size())).first->second;
+    }
+    return ids;
+}
+
+/**
+ * A repeated subtree: the nodes at `at` are a copy of those at `source`
+ */
+struct SubtreeRef {
+    std::uint32_t at;
+    std::uint32_t source;
+    std::uint32_t parent;
+};
+
+bool writeSnapshot(const ScanTree& tree, const fs::path& outFile, bool verbose = true) {
+    std::ofstream out(outFile, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error: Cannot create " << outFile << "\n";
+        return false;
+    }
+
+    // Keep the first copy of every subtree, reference the later ones
+    std::vector<std::uint32_t> ids = subtreeIds(tree);
+    std::unordered_map<std::uint32_t, std::uint32_t> firstSeen;
+    std::vector<std::uint32_t> kept;
+    std::vector<SubtreeRef> refs;
+    for (std::uint32_t i = 0; i < tree.count();) {
+        auto seen = firstSeen.emplace(ids[i], i);
+        if (!seen.second && tree.subtreeEnd[i] - i > 1) {
+            refs.push_back({i, seen.first->second, tree.parent[i]});
+            i = tree.subtreeEnd[i];
+            continue;
+        }
+        kept.push_back(i);
+        ++i;
+    }
+
+    ScanTree stored;
+    for (std::uint32_t i : kept) {
+        stored.namePool += tree.name(i);
+        stored.nameStart.push_back(stored.namePool.size());
+        stored.parent.push_back(tree.parent[i]);
+        stored.subtreeEnd.push_back(tree.subtreeEnd[i]);
+        stored.size.push_back(tree.size[i]);
+        stored.alloc.push_back(tree.alloc[i]);
+        stored.mtime.push_back(tree.mtime[i]);
+        stored.uid.push_back(tree.uid[i]);
+        stored.isFolder.push_back(tree.isFolder[i]);
+        stored.timedOut.push_back(tree.timedOut[i]);
+    }
+    std::vector<std::uint32_t> refAt, refSource, refParent;
+    for (const auto& ref : refs) {
+        refAt.push_back(ref.at);
+        refSource.push_back(ref.source);
+        refParent.push_back(ref.parent);
+    }
+
+    std::string root = tree.rootPath.u8string();
+    std::uint32_t count = tree.count();
+    std::uint32_t keptCount = stored.count();
+    std::uint32_t refCount = static_cast<std::uint32_t>(refs.size());
+    std::uint64_t poolSize = stored.namePool.size();
+    std::uint32_t rootLength = static_cast<std::uint32_t>(root.size());
+
+    out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(&keptCount), sizeof(keptCount));
+    out.write(reinterpret_cast<const char*>(&refCount), sizeof(refCount));
+    out.write(reinterpret_cast<const char*>(&poolSize), sizeof(poolSize));
+    out.write(reinterpret_cast<const char*>(&tree.scannedAt), sizeof(tree.scannedAt));
+    out.write(reinterpret_cast<const char*>(&rootLength), sizeof(rootLength));
+    out.write(root.data(), rootLength);
+
+    writeColumn(out, stored.nameStart);
+    writeColumn(out, stored.parent);
+    writeColumn(out, stored.subtreeEnd);
+    writeColumn(out, stored.size);
+    writeColumn(out, stored.alloc);
+    writeColumn(out, stored.mtime);
+    writeColumn(out, stored.uid);
+    writeColumn(out, stored.isFolder);
+    writeColumn(out, stored.timedOut);
+    writeColumn(out, refAt);
+    writeColumn(out, refSource);
+    writeColumn(out, refParent);
+    out.write(stored.namePool.data(), static_cast<std::streamsize>(poolSize));
+
+    if (!out) {
+        std::cerr << "Error: Cannot write " << outFile << "\n";
+        return false;
+    }
+    if (verbose) {
+        std::cout << "  Snapshot of " << count << " entries written to " << outFile.string();
+        if (refCount > 0) {
+            std::cout << " (" << (count - keptCount) << " in " << refCount << " repeated subtrees stored once)";
+        }
+        std::cout << "\n";
+    }
+    return true;
+}
+
+/**
+ * Rebuilds the full tree from the kept nodes, copying each referenced
+ * subtree from its first occurrence (always earlier in DFS order).
+ */
+bool expandSnapshot(const ScanTree& stored, const std::vector<SubtreeRef>& refs,
+                    std::uint32_t count, ScanTree& tree) {
+    tree.nameStart.assign(1, 0);
+    tree.nameStart.reserve(std::size_t(count) + 1);
+    tree.parent.reserve(count);
+    tree.subtreeEnd.reserve(count);
+    tree.uid.reserve(count);
+    tree.size.reserve(count);
+    tree.alloc.reserve(count);
+    tree.mtime.reserve(count);
+    tree.isFolder.reserve(count);
+    tree.timedOut.reserve(count);
+
+    auto append = [&tree](const ScanTree& from, std::uint32_t i, std::uint32_t parent, std::uint32_t end) {
+        tree.namePool += from.name(i);
+        tree.nameStart.push_back(tree.namePool.size());
+        tree.parent.push_back(parent);
+        tree.subtreeEnd.push_back(end);
+        tree.size.push_back(from.size[i]);
+        tree.alloc.push_back(from.alloc[i]);
+        tree.mtime.push_back(from.mtime[i]);
+        tree.uid.push_back(from.uid[i]);
+        tree.isFolder.push_back(from.isFolder[i]);
+        tree.timedOut.push_back(from.timedOut[i]);
+    };
+
+    std::size_t nextRef = 0;
+    auto expandRefs = [&]() {
+        while (nextRef < refs.size() && refs[nextRef].at == tree.count()) {
+            const SubtreeRef& ref = refs[nextRef++];
+            if (ref.source >= ref.at) return false;
+            std::uint32_t end = tree.subtreeEnd[ref.source];
+            std::uint32_t delta = ref.at - ref.source;
+            if (end > ref.at || std::uint64_t(end) + delta > count) return false;
+            for (std::uint32_t k = ref.source; k < end; ++k) {
+                append(tree, k, k == ref.source ? ref.parent : tree.parent[k] + delta, tree.subtreeEnd[k] + delta);
+            }
+        }
+        return true;
+    };
+
+    for (std::uint32_t i = 0; i < stored.count(); ++i) {
+        if (!expandRefs()) return false;
+        append(stored, i, stored.parent[i], stored.subtreeEnd[i]);
+    }
+    return expandRefs() && nextRef == refs.size() && tree.count() == count;
+}
+
+bool readSnapshot(const fs::path& inFile, ScanTree& tree) {
+    std::ifstream in(inFile, std::ios::binary);
+    char magic[sizeof(SNAPSHOT_MAGIC)] = {};
+    in.read(magic, sizeof(magic));
+    bool v1 = in && std::memcmp(magic, SNAPSHOT_MAGIC_V1, sizeof(magic)) == 0;
+    if (!in || (!v1 && std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)) {
+        std::cerr << "Error: Not a DiskScope snapshot: " << inFile << "\n";
+        return false;
+    }
+
+    std::uint32_t count = 0;
+    std::uint32_t keptCount = 0;
+    std::uint32_t refCount = 0;
+    std::uint64_t poolSize = 0;
+    std::uint32_t rootLength = 0;
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    keptCount = count;
+    if (!v1) {
+        in.read(reinterpret_cast<char*>(&keptCount), sizeof(keptCount));
+        in.read(reinterpret_cast<char*>(&refCount), sizeof(refCount));
+    }
+    in.read(reinterpret_cast<char*>(&poolSize), sizeof(poolSize));
+    in.read(reinterpret_cast<char*>(&tree.scannedAt), sizeof(tree.scannedAt));
+    in.read(reinterpret_cast<char*>(&rootLength), sizeof(rootLength));
+    std::string root(in ? rootLength : 0, '\0');
+    in.read(&root[0], static_cast<std::streamsize>(root.size()));
+    tree.rootPath = fs::u8path(root);
+
+    ScanTree stored;
+    std::vector<std::uint32_t> refAt, refSource, refParent;
+    bool ok = in && count > 0 && keptCount > 0 && keptCount <= count &&
+              readColumn(in, stored.nameStart, std::size_t(keptCount) + 1) &&
+              readColumn(in, stored.parent, keptCount) &&
+              readColumn(in, stored.subtreeEnd, keptCount) &&
+              readColumn(in, stored.size, keptCount) &&
+              readColumn(in, stored.alloc, keptCount) &&
+              readColumn(in, stored.mtime, keptCount) &&
+              readColumn(in, stored.uid, keptCount) &&
+              readColumn(in, stored.isFolder, keptCount) &&
+              readColumn(in, stored.timedOut, keptCount) &&
+              readColumn(in, refAt, refCount) &&
+              readColumn(in, refSource, refCount) &&
+              readColumn(in, refParent, refCount);
+    if (ok) {
+        stored.namePool.resize(poolSize);
+        in.read(&stored.namePool[0], static_cast<std::streamsize>(poolSize));
+        ok = static_cast<bool>(in) && stored.nameStart[keptCount] == poolSize;
+    }
+    for (std::uint32_t i = 0; ok && i < keptCount; ++i) {
+        ok = stored.nameStart[i] <= stored.nameStart[i + 1];
+    }
+
+    if (ok && refCount == 0) {
+        std::swap(tree.namePool, stored.namePool);
+        std::swap(tree.nameStart, stored.nameStart);
+        std::swap(tree.parent, stored.parent);
+        std::swap(tree.subtreeEnd, stored.subtreeEnd);
+        std::swap(tree.size, stored.size);
+        std::swap(tree.alloc, stored.alloc);
+        std::swap(tree.mtime, stored.mtime);
+        std::swap(tree.uid, stored.uid);
+        std::swap(tree.isFolder, stored.isFolder);
+        std::swap(tree.timedOut, stored.timedOut);
+    } else if (ok) {
+        std::vector<SubtreeRef> refs(refCount);
+        for (std::uint32_t r = 0; r < refCount; ++r) refs[r] = {refAt[r], refSource[r], refParent[r]};
+        ok = expandSnapshot(stored, refs, count, tree);
+    }
+
+    // Cheap sanity pass so a damaged file can't send lookups out of range
+    ok = ok && tree.count() == count;
+    for (std::uint32_t i = 0; ok && i < count; ++i) {
+        ok = tree.subtreeEnd[i] > i && tree.subtreeEnd[i] <= count &&
+             (i == 0 ? tree.parent[i] == NO_NODE : tree.parent[i] < i) &&
+             tree.nameStart[i] <= tree.nameStart[i + 1];
+    }
+    ok = ok && tree.nameStart[count] == tree.namePool.size();
+
+    if (!ok) {
+        std::cerr << "Error: Damaged snapshot: " << inFile << "\n";
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// SNAPSHOT BROWSING
+// ============================================================================
+
+/**
+ * Which files count toward the filtered column when browsing a snapshot
+ */
+struct FileFilter {
+    enum Kind { None, OlderThan, NewerThan, Owner, LargerThan, Extension } kind = None;
+    std::int64_t number = 0;    // cutoff time, uid or size
+    std::string text;           // extension
+    std::string label;          // column header
+
+    bool matches(const ScanTree& tree, std::uint32_t node) const {
+        switch (kind) {
+            case OlderThan:  return tree.mtime[node] < number;
+            case NewerThan:  return tree.mtime[node] >= number;
+            case Owner:      return tree.uid[node] == static_cast<std::uint32_t>(number);
+            case LargerThan: return tree.size[node] >= static_cast<std::uintmax_t>(number);
+            case Extension: {
+                std::string_view name = tree.name(node);
+                return name.size() >= text.size() && name.substr(name.size() - text.size()) == text;
+            }
+            default:         return false;
+        }
+    }
+};
+
+/**
+ * Parses a byte count like "512", "100M" or "1.5G" (K/M/G/T, powers of 1024).
+ */
+bool parseSize(const std::string& value, std::uint64_t& bytes) {
+    try {
+        std::size_t used = 0;
+        double number = std::stod(value, &used);
+        std::string suffix = value.substr(used);
+        const std::string units = "KMGT";
+        std::size_t unit = suffix.empty() ? std::string::npos : units.find(static_cast<char>(toupper(suffix[0])));
+        if ((!suffix.empty() && unit == std::string::npos) || number < 0) return false;
+        for (std::size_t u = 0; unit != std::string::npos && u <= unit; ++u) number *= 1024.0;
+        bytes = static_cast<std::uint64_t>(number);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+/**
+ * Parses "older DAYS", "newer DAYS", "uid N", "larger SIZE" (K/M/G/T
+ * suffix allowed) or "ext .EXT". Returns false if it doesn't parse.
+ */
+bool parseFilter(const std::string& spec, FileFilter& filter) {
+    std::istringstream iss(spec);
+    std::string kind, value;
+    iss >> kind >> value;
+    if (value.empty()) return false;
+
+    FileFilter parsed;
+    try {
+        std::size_t used = 0;
+        if (kind == "older" || kind == "newer") {
+            std::int64_t days = std::stoll(value, &used);
+            parsed.kind = kind == "older" ? FileFilter::OlderThan : FileFilter::NewerThan;
+            parsed.number = static_cast<std::int64_t>(std::time(nullptr)) - days * 86400;
+            parsed.label = kind + " " + value + "d";
+        } else if (kind == "uid") {
+            parsed.kind = FileFilter::Owner;
+            parsed.number = std::stoll(value, &used);
+            parsed.label = "uid " + value;
+        } else if (kind == "larger") {
+            std::uint64_t bytes = 0;
+            if (!parseSize(value, bytes)) return false;
+            used = value.size();
+            parsed.kind = FileFilter::LargerThan;
+            parsed.number = static_cast<std::int64_t>(bytes);
+            parsed.label = ">= " + value;
+        } else if (kind == "ext") {
+            parsed.kind = FileFilter::Extension;
+            parsed.text = value;
+            used = value.size();
+            parsed.label = "*" + value;
+        } else {
+            return false;
+        }
+        if (used != value.size()) return false;
+    } catch (...) {
+        return false;
+    }
+
+    filter = parsed;
+    return true;
+}
+
+/**
+ * Bytes of matching files below every node, as prefix sums: one pass over
+ * the tree per filter, then two lookups per folder on screen.
+ */
+SubtreeSums filteredSums(const ScanTree& tree, const FileFilter& filter) {
+    return buildSubtreeSums(tree, [&](std::uint32_t i) -> std::uint64_t {
+        return !tree.isFolder[i] && filter.matches(tree, i) ? tree.size[i] : 0;
+    });
+}
+
+/**
+ * Same as getSubfolders(), but answered from a loaded snapshot
+ */
+std::vector<FolderEntry> treeSubfolders(const ScanTree& tree, const fs::path& folderPath) {
+    std::vector<FolderEntry> folders;
+    std::uint32_t node = findNode(tree, folderPath);
+    if (node == NO_NODE) {
+        return folders;
+    }
+
+    for (std::uint32_t c : sortedChildren(tree, node)) {
+        if (!tree.isFolder[c]) continue;
+        FolderEntry folder;
+        folder.name = std::string(tree.name(c));
+        folder.path = folderPath / fs::u8path(folder.name);
+        folder.size = tree.size[c];
+        folder.accessDenied = false;
+        folder.timedOut = tree.timedOut[c] != 0;
+        folder.node = c;
+        folders.push_back(folder);
+    }
+    return folders;
+}
+
+/**
+ * Own-size leaders of the folders below `top` in a finished tree, for
+ * snapshots, where nothing was collected while scanning.
+ */
+OwnLeaders treeOwnLeaders(const ScanTree& tree, std::uint32_t top) {
+    std::uint32_t end = tree.subtreeEnd[top];
+    std::vector<std::uintmax_t> bytes(end - top);
+    std::vector<std::uint64_t> files(end - top);
+    for (std::uint32_t i = top + 1; i < end; ++i) {
+        if (!tree.isFolder[i]) {
+            bytes[tree.parent[i] - top] += tree.size[i];
+            files[tree.parent[i] - top]++;
+        }
+    }
+
+    OwnLeaders leaders;
+    for (std::uint32_t i = top; i < end; ++i) {
+        std::uint32_t k = i - top;
+        if (tree.isFolder[i] && (leaders.bySize.accepts(bytes[k]) || leaders.byFiles.accepts(files[k]))) {
+            leaders.offer(fs::u8path(nodePath(tree, i)), bytes[k], files[k]);
+        }
+    }
+    return leaders;
+}
+
+/** Both lists as one: largest own size first, then most own files */
+std::vector<OwnUsage> ownLeaderRows(const OwnLeaders& leaders) {
+    std::vector<OwnUsage> rows = leaders.bySize.sorted();
+    std::vector<OwnUsage> byFiles = leaders.byFiles.sorted();
+    rows.insert(rows.end(), byFiles.begin(), byFiles.end());
+    return rows;
+}
+
+/**
+ * Prints the folders whose own files (not their subfolders') are the
+ * largest and the most numerous, numbered as in ownLeaderRows().
+ */
+void printOwnLeaders(const OwnLeaders& leaders, const fs::path& under, bool numbered) {
+    std::vector<OwnUsage> rows = ownLeaderRows(leaders);
+    std::size_t sizeRows = leaders.bySize.sorted().size();
+
+    std::cout << "\n============================================================\n";
+    std::cout << "  Folders by own files (below " << under.string() << ")\n";
+    std::cout << "============================================================\n";
+    if (rows.empty()) {
+        std::cout << "\n  (No files found)\n";
+        return;
+    }
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        if (i == 0 || i == sizeRows) {
+            std::cout << (i == 0 ? "\n  Largest own size\n" : "\n  Most own files\n");
+        }
+        std::cout << "  ";
+        if (numbered) std::cout << "[" << std::setw(2) << i << "] ";
+        std::cout << std::setw(12) << formatSize(rows[i].bytes) << std::setw(10) << rows[i].files << " files  "
+                  << rows[i].path.string() << "\n";
+    }
+}
+
+// ============================================================================
+// HEAVIEST PATH (branch and bound)
+// ============================================================================
+
+/**
+ * Finds the chain "biggest subfolder of the biggest subfolder ..." without
+ * scanning everything. Sizes are bytes on disk, so the filesystem's used
+ * space bounds them: a subtree can hold at most what is used minus what
+ * has been counted outside it. At each level every subfolder is looked
+ * into once, then the heaviest unresolved one is opened further, until
+ * the leader's counted bytes reach every rival's upper bound. Stays on
+ * the starting filesystem, like du -x.
+ */
+class HeaviestPath {
+public:
+    explicit HeaviestPath(const fs::path& rootPath) {
+        EntryInfo info;
+        if (fsBackend->stat(rootPath, info) == FsResult::Ok) {
+            device = info.device;
+        }
+        std::error_code ec;
+        fs::space_info space = fs::space(rootPath, ec);
+        used = ec ? 0 : space.capacity - space.free;
+        addNode(rootPath.u8string(), rootPath, NO_NODE);
+        firstVisit(visited.get(), rootPath);
+    }
+
+    bool run() {
+        std::cout << "\nHeaviest path below " << nodes[0].path.string() << " (on-disk sizes, "
+                  << formatSize(used) << " used on this filesystem)\n\n";
+        if (!expand(0)) {
+            std::cerr << "Error: Can't read " << nodes[0].path << "\n";
+            return false;
+        }
+
+        std::vector<std::uint32_t> chain;
+        std::uint32_t current = 0;
+        while (true) {
+            if (!nodes[current].opened) expand(current);
+            if (nodes[current].children.empty()) break;
+            std::uint32_t leader = settleLeader(current);
+            // Files directly in this folder outweigh any subfolder: stop here
+            if (nodes[current].own >= upper(leader)) break;
+            chain.push_back(leader);
+            current = leader;
+        }
+
+        // Printed at the end, when the bounds are as tight as they will get
+        for (std::size_t depth = 0; depth < chain.size(); ++depth) {
+            const Node& node = nodes[chain[depth]];
+            std::cout << "  " << std::setw(3) << depth + 1 << "  " << std::left << std::setw(40)
+                      << node.name << std::right << (resolved(chain[depth]) ? "   " : ">= ")
+                      << std::setw(12) << formatSize(node.lower)
+                      << (node.timedOut ? "  (timed out, partial)" : "") << "\n";
+        }
+        std::cout << "\n  Culprit: " << nodes[current].path.string() << "\n";
+        std::cout << "  Own files: " << formatSize(nodes[current].own) << ", opened "
+                  << expanded << " folders, counted " << formatSize(scanned) << "\n";
+        return true;
+    }
+
+private:
+    struct Node {
+        std::string name;
+        fs::path path;
+        std::uint32_t parent;
+        std::vector<std::uint32_t> children;
+        std::uint64_t own = 0;          // files directly inside
+        std::uint64_t lower = 0;        // counted so far in the subtree
+        std::uint32_t pending = 1;      // folders in the subtree not opened yet
+        bool opened = false;
+        bool timedOut = false;
+    };
+
+    std::vector<Node> nodes;
+    std::uint64_t device = 0;
+    std::uint64_t used = 0;
+    std::uint64_t scanned = 0;
+    std::size_t expanded = 0;
+    std::unique_ptr<VisitedSet> visited = followSymlinks ? std::make_unique<VisitedSet>() : nullptr;
+
+    bool resolved(std::uint32_t n) const {
+        return nodes[n].pending == 0;
+    }
+
+    std::uint64_t upper(std::uint32_t n) const {
+        if (resolved(n)) return nodes[n].lower;
+        std::uint64_t outside = scanned - nodes[n].lower;
+        return used > outside ? std::max(nodes[n].lower, used - outside) : nodes[n].lower;
+    }
+
+    /**
+     * Opens folders below `folder` until one subfolder provably holds the
+     * most, and returns it.
+     */
+    std::uint32_t settleLeader(std::uint32_t folder) {
+        // One look into each rival first, so their own files give a start
+        for (std::size_t i = 0; i < nodes[folder].children.size(); ++i) {
+            std::uint32_t c = nodes[folder].children[i];
+            if (!nodes[c].opened) expand(c);
+        }
+
+        while (true) {
+            const auto& children = nodes[folder].children;
+            std::uint32_t leader = children[0];
+            for (std::uint32_t c : children) {
+                if (nodes[c].lower > nodes[leader].lower) leader = c;
+            }
+
+            std::uint32_t heaviestOpen = NO_NODE;   // heaviest unresolved child
+            bool proven = true;
+            for (std::uint32_t c : children) {
+                if (c != leader && upper(c) > nodes[leader].lower) proven = false;
+                if (!resolved(c) && (heaviestOpen == NO_NODE || nodes[c].lower > nodes[heaviestOpen].lower)) {
+                    heaviestOpen = c;
+                }
+            }
+            if (proven || heaviestOpen == NO_NODE) return leader;
+
+            // Heaviest first all the way down to a folder not opened yet
+            std::uint32_t n = heaviestOpen;
+            while (nodes[n].opened) {
+                std::uint32_t next = NO_NODE;
+                for (std::uint32_t c : nodes[n].children) {
+                    if (!resolved(c) && (next == NO_NODE || nodes[c].lower > nodes[next].lower)) next = c;
+                }
+                n = next;
+            }
+            expand(n);
+        }
+    }
+
+    std::uint32_t addNode(const std::string& name, const fs::path& path, std::uint32_t parent) {
+        Node node;
+        node.name = name;
+        node.path = path;
+        node.parent = parent;
+        nodes.push_back(std::move(node));
+        return static_cast<std::uint32_t>(nodes.size() - 1);
+    }
+
+    /**
+     * Lists one folder: counts its files into every ancestor and adds
+     * its subfolders as unopened nodes. False if it couldn't be listed.
+     */
+    bool expand(std::uint32_t n) {
+        nodes[n].opened = true;
+        expanded++;
+
+        std::vector<DirEntry> entries;
+        FsResult listed = fsBackend->list(nodes[n].path, entries);
+        std::uint64_t bytes = 0;
+        std::uint32_t added = 0;
+        if (listed == FsResult::Ok) {
+            for (const auto& entry : entries) {
+                if (entry.type == EntryType::Other) continue;
+                EntryInfo info;
+                FsResult result = fsBackend->stat(entry.path, info);
+                if (result == FsResult::TimedOut) {
+                    nodes[n].timedOut = true;
+                    break;
+                }
+                if (result != FsResult::Ok) continue;
+
+                if (entry.type == EntryType::File) {
+                    bytes += info.alloc;
+                } else if (info.device == device && firstVisit(visited.get(), entry.path)) {
+                    std::uint32_t child = addNode(entry.name, entry.path, n);
+                    nodes[n].children.push_back(child);
+                    added++;
+                }
+            }
+        } else {
+            nodes[n].timedOut = listed == FsResult::TimedOut;
+        }
+
+        nodes[n].own = bytes;
+        scanned += bytes;
+        for (std::uint32_t a = n; a != NO_NODE; a = nodes[a].parent) {
+            nodes[a].lower += bytes;
+            nodes[a].pending = nodes[a].pending + added - 1;
+        }
+        return listed == FsResult::Ok;
+    }
+};
+
+// ============================================================================
+// SLOW-PATH REPORT
+// ============================================================================
+
+// Folders at or above this percentile of own scan time are flagged
+const double SLOW_PERCENTILE = 99.0;
+const std::size_t SLOW_REPORT_ROWS = 20;
+// A subtree that spends this share of its time in one child is just a
+// pass-through to that child and isn't listed itself
+const double SLOW_PASS_THROUGH = 0.9;
+
+/**
+ * Prints per-device metadata latency percentiles, the folders whose own
+ * list + stat time is in the top percentile, and the slowest subtrees.
+ */
+void printSlowReport(const ScanTree& tree) {
+    std::cout << "\n============================================================\n";
+    std::cout << "  Metadata latency by device\n";
+    std::cout << "============================================================\n";
+
+    {
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        for (const auto& device : latencyByDevice) {
+            std::cout << "\n  " << device.second->label << "\n";
+            std::cout << "    op     " << std::setw(10) << "count" << std::setw(10) << "p50"
+                      << std::setw(10) << "p90" << std::setw(10) << "p99"
+                      << std::setw(10) << "p99.9" << std::setw(10) << "max" << "\n";
+            const std::pair<const char*, const LatencyHistogram*> ops[] = {
+                {"list", &device.second->list}, {"stat", &device.second->stat}};
+            for (const auto& op : ops) {
+                std::cout << "    " << std::left << std::setw(7) << op.first << std::right
+                          << std::setw(10) << op.second->total();
+                for (double p : {50.0, 90.0, 99.0, 99.9, 100.0}) {
+                    std::cout << std::setw(10) << formatDuration(op.second->percentile(p));
+                }
+                std::cout << "\n";
+            }
+        }
+    }
+
+    if (tree.folderNanos.empty()) {
+        return;
+    }
+
+    // Folders whose own time is in the top percentile
+    std::vector<std::pair<std::uint32_t, std::uint64_t>> byOwn = tree.folderNanos;
+    std::sort(byOwn.begin(), byOwn.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    std::size_t flagged = static_cast<std::size_t>(byOwn.size() * (100.0 - SLOW_PERCENTILE) / 100.0) + 1;
+    flagged = std::min(flagged, byOwn.size());
+
+    std::cout << "\n------------------------------------------------------------\n";
+    std::cout << "  Slowest folders (own list + stat time, top " << (100.0 - SLOW_PERCENTILE) << "%)\n";
+    std::cout << "------------------------------------------------------------\n";
+    for (std::size_t i = 0; i < flagged && i < SLOW_REPORT_ROWS; ++i) {
+        std::cout << "  " << std::setw(10) << formatDuration(byOwn[i].second) << "  "
+                  << nodePath(tree, byOwn[i].first) << "\n";
+    }
+    if (flagged > SLOW_REPORT_ROWS) {
+        std::cout << "  ... and " << (flagged - SLOW_REPORT_ROWS) << " more\n";
+    }
+
+    // Inclusive time per folder (children always come after parents)
+    std::vector<std::uint64_t> subtreeNanos(tree.count(), 0);
+    for (const auto& timing : tree.folderNanos) {
+        subtreeNanos[timing.first] = timing.second;
+    }
+    std::vector<std::uint64_t> biggestChild(tree.count(), 0);
+    for (std::uint32_t i = tree.count(); i-- > 1;) {
+        std::uint32_t p = tree.parent[i];
+        subtreeNanos[p] += subtreeNanos[i];
+        biggestChild[p] = std::max(biggestChild[p], subtreeNanos[i]);
+    }
+
+    std::vector<std::uint32_t> subtrees;
+    for (const auto& timing : tree.folderNanos) {
+        std::uint32_t n = timing.first;
+        if (n != 0 && biggestChild[n] < SLOW_PASS_THROUGH * static_cast<double>(subtreeNanos[n])) {
+            subtrees.push_back(n);
+        }
+    }
+    std::sort(subtrees.begin(), subtrees.end(), [&subtreeNanos](std::uint32_t a, std::uint32_t b) {
+        return subtreeNanos[a] > subtreeNanos[b];
+    });
+
+    std::uint64_t totalNanos = std::max<std::uint64_t>(subtreeNanos[0], 1);
+    std::cout << "\n------------------------------------------------------------\n";
+    std::cout << "  Slowest subtrees (total " << formatDuration(subtreeNanos[0]) << " of metadata time)\n";
+    std::cout << "------------------------------------------------------------\n";
+    for (std::size_t i = 0; i < subtrees.size() && i < SLOW_REPORT_ROWS; ++i) {
+        std::uint32_t n = subtrees[i];
+        std::cout << "  " << std::setw(10) << formatDuration(subtreeNanos[n])
+                  << std::setw(6) << (subtreeNanos[n] * 100 / totalNanos) << "%  "
+                  << nodePath(tree, n) << "\n";
+    }
+}
+
+// ============================================================================
+// DUPLICATE FOLDERS (Merkle fingerprints + MinHash)
+// ============================================================================
+
+// Folders smaller than this are not reported
+const std::uintmax_t DUPLICATE_MIN_SIZE = 1024 * 1024;
+// Per folder: the 32 smallest hashes of everything below it; LSH in 8 bands of 4
+const int SKETCH_SIZE = 32;
+const int SKETCH_BANDS = 8;
+const int SKETCH_ROWS = SKETCH_SIZE / SKETCH_BANDS;
+const double NEAR_DUPLICATE_SIMILARITY = 0.8;
+const std::size_t DUPLICATE_REPORT_ROWS = 25;
+
+using Sketch = std::array<std::uint32_t, SKETCH_SIZE>;
+
+std::uint64_t mix64(std::uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+std::uint64_t hashName(std::string_view name) {
+    std::uint64_t h = 14695981039346656037ull;      // FNV-1a
+    for (unsigned char c : name) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    return mix64(h);
+}
+
+struct DuplicateFinding {
+    std::vector<std::uint32_t> folders;
+    bool identical;
+    double similarity;
+    std::uint64_t reclaimable;
+};
+
+/**
+ * Reports folders that are copies of each other, largest waste first.
+ * One backward walk gives every folder a fingerprint of the names and
+ * sizes below it (equal fingerprints = identical trees, whatever the
+ * folders themselves are called) and a MinHash sketch of its entries.
+ * Sketches that agree on a whole band become candidate pairs, so the
+ * cost stays linear in the tree size.
+ */
+void printDuplicateReport(const ScanTree& tree) {
+    const std::uint32_t count = tree.count();
+    std::vector<std::uint64_t> fingerprint(count);
+    std::unordered_map<std::uint32_t, Sketch> pending;     // finished folders waiting for their parent
+    std::vector<std::uint32_t> candidates;                 // folders big enough to report
+    std::vector<Sketch> sketches;
+
+    // Children come after their parent, so walking backwards is bottom-up
+    for (std::uint32_t i = count; i-- > 0;) {
+        if (!tree.isFolder[i]) {
+            fingerprint[i] = mix64(tree.size[i] ^ 0x9e3779b97f4a7c15ull);
+            continue;
+        }
+
+        Sketch sketch;
+        sketch.fill(UINT32_MAX);
+        std::uint64_t sum = 0;
+        std::uint64_t entries = 0;
+        for (std::uint32_t c = i + 1; c < tree.subtreeEnd[i]; c = tree.subtreeEnd[c]) {
+            std::uint64_t entry = mix64(hashName(tree.name(c)) + fingerprint[c] * 31);
+            sum += entry;       // order doesn't matter, so no sorting
+            entries++;
+
+            // k-th hash of the entry by double hashing
+            std::uint32_t a = static_cast<std::uint32_t>(entry);
+            std::uint32_t b = static_cast<std::uint32_t>(entry >> 32) | 1;
+            for (int k = 0; k < SKETCH_SIZE; ++k) {
+                sketch[k] = std::min(sketch[k], a + static_cast<std::uint32_t>(k) * b);
+            }
+            auto child = pending.find(c);
+            if (child != pending.end()) {
+                for (int k = 0; k < SKETCH_SIZE; ++k) {
+                    sketch[k] = std::min(sketch[k], child->second[k]);
+                }
+                pending.erase(child);
+            }
+        }
+        fingerprint[i] = mix64(sum ^ mix64(entries));
+
+        if (i != 0 && tree.size[i] >= DUPLICATE_MIN_SIZE) {
+            candidates.push_back(i);
+            sketches.push_back(sketch);
+        }
+        pending.emplace(i, sketch);
+    }
+
+    // Each group in pre-order (candidates were found bottom-up)
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> byFingerprint;
+    for (std::uint32_t folder : candidates) {
+        byFingerprint[fingerprint[folder]].push_back(folder);
+    }
+    for (auto& group : byFingerprint) {
+        std::reverse(group.second.begin(), group.second.end());
+    }
+    auto identicalToOther = [&](std::uint32_t folder) {
+        auto it = byFingerprint.find(fingerprint[folder]);
+        return it != byFingerprint.end() && it->second.size() > 1;
+    };
+
+    std::vector<DuplicateFinding> findings;
+
+    // Similar: sketches agreeing on a band; neighbours by size in each bucket are compared
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> buckets;
+    for (std::uint32_t s = 0; s < sketches.size(); ++s) {
+        for (int band = 0; band < SKETCH_BANDS; ++band) {
+            std::uint64_t key = mix64(static_cast<std::uint64_t>(band) + 1);
+            for (int r = 0; r < SKETCH_ROWS; ++r) {
+                key = mix64(key ^ sketches[s][band * SKETCH_ROWS + r]);
+            }
+            buckets[key].push_back(s);
+        }
+    }
+    std::unordered_set<std::uint64_t> pairs;
+    for (auto& bucket : buckets) {
+        std::vector<std::uint32_t>& members = bucket.second;
+        std::sort(members.begin(), members.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return tree.size[candidates[a]] > tree.size[candidates[b]];
+        });
+        for (std::size_t m = 1; m < members.size(); ++m) {
+            std::uint32_t a = std::min(members[m - 1], members[m]);
+            std::uint32_t b = std::max(members[m - 1], members[m]);
+            pairs.insert(static_cast<std::uint64_t>(a) << 32 | b);
+        }
+    }
+
+    // A copy of `other` inside `folder` is the first group member after it
+    auto holdsCopyOf = [&](std::uint32_t folder, std::uint32_t other) {
+        auto group = byFingerprint.find(fingerprint[other]);
+        if (group == byFingerprint.end()) return false;
+        auto copy = std::lower_bound(group->second.begin(), group->second.end(), folder + 1);
+        return copy != group->second.end() && *copy < tree.subtreeEnd[folder];
+    };
+    // Pairs are remembered by content, so copies of a reported pair count as reported
+    auto pairKey = [&](std::uint32_t x, std::uint32_t y) {
+        std::uint64_t a = fingerprint[x];
+        std::uint64_t b = fingerprint[y];
+        return mix64(std::min(a, b)) ^ std::max(a, b);
+    };
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> similar;   // sketch indices
+    for (std::uint64_t pair : pairs) {
+        std::uint32_t a = static_cast<std::uint32_t>(pair >> 32);
+        std::uint32_t b = static_cast<std::uint32_t>(pair);
+        std::uint32_t x = candidates[a];
+        std::uint32_t y = candidates[b];
+        if (fingerprint[x] == fingerprint[y]) continue;
+        // A folder and its own subfolder look alike, but aren't copies
+        if (std::max(x, y) < tree.subtreeEnd[std::min(x, y)]) continue;
+        // Nor is a folder holding an identical copy of the other
+        if (holdsCopyOf(x, y) || holdsCopyOf(y, x)) continue;
+        similar.push_back({a, b});
+    }
+
+    // Parents before children, so a pair inside a reported pair can be dropped
+    std::sort(similar.begin(), similar.end(), [&](const auto& p, const auto& q) {
+        return std::min(candidates[p.first], candidates[p.second]) <
+               std::min(candidates[q.first], candidates[q.second]);
+    });
+    std::unordered_set<std::uint64_t> reported;
+    std::unordered_set<std::uint64_t> similarReported;  // fingerprints of folders in reported pairs
+    for (const auto& pair : similar) {
+        std::uint32_t x = candidates[pair.first];
+        std::uint32_t y = candidates[pair.second];
+        std::uint32_t px = tree.parent[x];
+        std::uint32_t py = tree.parent[y];
+        if ((px != py && fingerprint[px] == fingerprint[py]) || reported.count(pairKey(px, py))) {
+            reported.insert(pairKey(x, y));
+            continue;
+        }
+
+        int agree = 0;
+        for (int k = 0; k < SKETCH_SIZE; ++k) {
+            agree += sketches[pair.first][k] == sketches[pair.second][k];
+        }
+        double similarity = static_cast<double>(agree) / SKETCH_SIZE;
+        if (similarity < NEAR_DUPLICATE_SIMILARITY) continue;
+
+        reported.insert(pairKey(x, y));
+        similarReported.insert(fingerprint[x]);
+        similarReported.insert(fingerprint[y]);
+        std::uint64_t shared = static_cast<std::uint64_t>(similarity * std::min(tree.size[x], tree.size[y]));
+        findings.push_back({{std::min(x, y), std::max(x, y)}, false, similarity, shared});
+    }
+
+    // Identical: only where the parents aren't already copies themselves
+    for (auto& group : byFingerprint) {
+        std::vector<std::uint32_t>& folders = group.second;
+        if (folders.size() < 2) continue;
+        std::size_t covered = 0;
+        for (std::uint32_t folder : folders) {
+            std::uint32_t parent = tree.parent[folder];
+            if (identicalToOther(parent) || similarReported.count(fingerprint[parent])) covered++;
+        }
+        if (covered == folders.size()) continue;
+
+        std::size_t extra = folders.size() - covered - (covered == 0 ? 1 : 0);
+        findings.push_back({folders, true, 1.0, tree.size[folders[0]] * extra});
+    }
+
+    std::sort(findings.begin(), findings.end(), [](const auto& a, const auto& b) {
+        return a.reclaimable > b.reclaimable;
+    });
+
+    std::cout << "\n============================================================\n";
+    std::cout << "  Duplicate folders (" << formatSize(DUPLICATE_MIN_SIZE) << " or more)\n";
+    std::cout << "============================================================\n";
+    if (findings.empty()) {
+        std::cout << "\n  None found\n";
+        return;
+    }
+    for (std::size_t i = 0; i < findings.size() && i < DUPLICATE_REPORT_ROWS; ++i) {
+        const DuplicateFinding& finding = findings[i];
+        std::cout << "\n  " << std::setw(12) << formatSize(finding.reclaimable) << "  ";
+        if (finding.identical) {
+            std::cout << "identical x" << finding.folders.size() << "\n";
+        } else {
+            std::cout << "~" << std::min(99, static_cast<int>(finding.similarity * 100 + 0.5)) << "% similar\n";
+        }
+        for (std::uint32_t folder : finding.folders) {
+            std::cout << "                " << nodePath(tree, folder) << "  (" << formatSize(tree.size[folder]) << ")\n";
+        }
+    }
+}
+
+// ============================================================================
+// PACKAGE ATTRIBUTION (dpkg / rpm file lists)
+// ============================================================================
+
+const std::size_t PACKAGE_REPORT_ROWS = 25;
+// A folder is listed only if no single subfolder holds this much of its bytes
+const double DOMINANT_SHARE = 0.9;
+
+// Where the file lists come from: a dpkg info dir, a "package<TAB>path" file, or empty for the system
+fs::path packageDatabase;
+
+struct PackageFiles {
+    std::vector<std::string> names;
+    std::vector<std::pair<std::uint32_t, std::string>> files;  // package index, absolute path
+};
+
+void readPackageLines(std::istream& in, PackageFiles& db) {
+    std::unordered_map<std::string, std::uint32_t> index;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::size_t tab = line.find('\t');
+        if (tab == std::string::npos || tab + 1 >= line.size()) continue;
+        std::string name = line.substr(0, tab);
+        auto found = index.emplace(name, static_cast<std::uint32_t>(db.names.size()));
+        if (found.second) db.names.push_back(name);
+        db.files.push_back({found.first->second, line.substr(tab + 1)});
+    }
+}
+
+/**
+ * Reads every dpkg *.list file in a directory, one package per file,
+ * several files at a time.
+ */
+bool readDpkgLists(const fs::path& dir, PackageFiles& db) {
+    std::vector<fs::path> lists;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == ".list") lists.push_back(it->path());
+    }
+    if (ec) {
+        std::cerr << "Error: Cannot read package lists in " << dir.string() << ": " << ec.message() << "\n";
+        return false;
+    }
+    std::sort(lists.begin(), lists.end());
+
+    std::vector<std::vector<std::string>> contents(lists.size());
+    std::atomic<std::size_t> next{0};
+    std::size_t workers = std::min<std::size_t>(lists.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<void>> pool;
+    for (std::size_t w = 0; w < workers; ++w) {
+        pool.push_back(std::async(std::launch::async, [&]() {
+            for (std::size_t j; (j = next++) < lists.size();) {
+                std::ifstream in(lists[j]);
+                for (std::string line; std::getline(in, line);) {
+                    if (!line.empty() && line != "/.") contents[j].push_back(std::move(line));
+                }
+            }
+        }));
+    }
+    for (auto& worker : pool) worker.get();
+
+    for (std::size_t j = 0; j < lists.size(); ++j) {
+        auto package = static_cast<std::uint32_t>(db.names.size());
+        db.names.push_back(lists[j].stem().string());     // "libc6:amd64"
+        for (std::string& file : contents[j]) {
+            db.files.push_back({package, std::move(file)});
+        }
+    }
+    return true;
+}
+
+/**
+ * Loads the installed packages' file lists. The dpkg lists are plain
+ * files; the rpm database isn't, so rpm is asked once for all of them.
+ */
+bool readPackageDatabase(PackageFiles& db) {
+    if (!packageDatabase.empty()) {
+        if (fs::is_directory(packageDatabase)) return readDpkgLists(packageDatabase, db);
+        std::ifstream in(packageDatabase);
+        if (!in) {
+            std::cerr << "Error: Cannot open package database: " << packageDatabase.string() << "\n";
+            return false;
+        }
+        readPackageLines(in, db);
+        return true;
+    }
+
+    if (fs::is_directory("/var/lib/dpkg/info")) return readDpkgLists("/var/lib/dpkg/info", db);
+#ifndef _WIN32
+    if (fs::exists("/var/lib/rpm")) {
+        FILE* pipe = popen("rpm -qa --queryformat '[%{NAME}\\t%{FILENAMES}\\n]' 2>/dev/null", "r");
+        if (pipe) {
+            std::string output;
+            char buffer[65536];
+            for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0;) {
+                output.append(buffer, n);
+            }
+            if (pclose(pipe) == 0) {
+                std::istringstream in(output);
+                readPackageLines(in, db);
+                return true;
+            }
+        }
+    }
+#endif
+    std::cerr << "Error: No package database found (use --package-db)\n";
+    return false;
+}
+
+/**
+ * Folders with bytes, most first, skipping those that only pass nearly
+ * all of them on to one subfolder (so a deep chain is listed once).
+ */
+std::vector<std::uint32_t> spreadFolders(const ScanTree& tree, const std::vector<std::uint64_t>& bytes) {
+    std::vector<std::uint32_t> folders;
+    for (std::uint32_t i = 0; i < tree.count(); ++i) {
+        if (!tree.isFolder[i] || bytes[i] == 0) continue;
+        bool dominated = false;
+        for (std::uint32_t c = i + 1; c < tree.subtreeEnd[i]; c = tree.subtreeEnd[c]) {
+            if (tree.isFolder[c] && bytes[c] >= bytes[i] * DOMINANT_SHARE) {
+                dominated = true;
+                break;
+            }
+        }
+        if (!dominated) folders.push_back(i);
+    }
+    std::sort(folders.begin(), folders.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return bytes[a] > bytes[b];
+    });
+    return folders;
+}
+
+std::uint64_t pathStep(std::uint64_t parent, std::string_view name) {
+    return mix64(parent * 31 + hashName(name));
+}
+
+/**
+ * Attributes every file in the tree to the package that installed it,
+ * then reports the biggest packages and where the unowned bytes are.
+ * The tree is indexed once by a hash of each file's path, so a lookup
+ * is a hash of the listed path instead of a walk through the folders;
+ * lookups run in parallel chunks.
+ */
+bool printPackageReport(const ScanTree& tree) {
+    PackageFiles db;
+    if (!readPackageDatabase(db)) return false;
+
+    const std::uint32_t count = tree.count();
+    std::vector<std::uint64_t> pathHash(count);
+    std::unordered_map<std::uint64_t, std::uint32_t> files;
+    files.reserve(count);
+    for (std::uint32_t i = 1; i < count; ++i) {
+        pathHash[i] = pathStep(pathHash[tree.parent[i]], tree.name(i));
+        if (!tree.isFolder[i]) files.emplace(pathHash[i], i);
+    }
+
+    // Merged /usr: lists say /bin/ls, the tree has /usr/bin/ls
+    std::map<std::string, std::string> topLevel;
+    for (const auto& file : db.files) {
+        std::size_t slash = file.second.find('/', 1);
+        std::string top = file.second.substr(0, slash);
+        if (topLevel.count(top)) continue;
+        std::error_code ec;
+        fs::path real = fs::is_symlink(top, ec) ? fs::canonical(top, ec) : fs::path(top);
+        topLevel[top] = ec ? top : real.string();
+    }
+
+    // Listed paths that resolve to a file in the tree, per chunk
+    std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> found;   // node, package
+    const std::size_t chunkSize = 4096;
+    found.resize((db.files.size() + chunkSize - 1) / chunkSize);
+    std::atomic<std::size_t> next{0};
+    std::size_t workers = std::min<std::size_t>(found.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<void>> pool;
+    for (std::size_t w = 0; w < workers; ++w) {
+        pool.push_back(std::async(std::launch::async, [&]() {
+            for (std::size_t j; (j = next++) < found.size();) {
+                std::size_t end = std::min(db.files.size(), (j + 1) * chunkSize);
+                for (std::size_t f = j * chunkSize; f < end; ++f) {
+                    const std::string& listed = db.files[f].second;
+                    std::size_t slash = listed.find('/', 1);
+                    fs::path path = topLevel.at(listed.substr(0, slash)) +
+                                    (slash == std::string::npos ? "" : listed.substr(slash));
+                    fs::path relative = path.lexically_relative(tree.rootPath);
+                    if (relative.empty() || *relative.begin() == ".." || relative == ".") continue;
+
+                    std::uint64_t hash = 0;
+                    std::string last;
+                    for (const auto& part : relative) {
+                        last = part.u8string();
+                        hash = pathStep(hash, last);
+                    }
+                    auto hit = files.find(hash);
+                    if (hit != files.end() && tree.name(hit->second) == last) {
+                        found[j].push_back({hit->second, db.files[f].first});
+                    }
+                }
+            }
+        }));
+    }
+    for (auto& worker : pool) worker.get();
+
+    // A file listed by several packages (diversions) counts for the first
+    const std::uint32_t NO_PACKAGE = UINT32_MAX;
+    std::vector<std::uint32_t> owner(count, NO_PACKAGE);
+    for (const auto& chunk : found) {
+        for (const auto& hit : chunk) {
+            if (owner[hit.first] == NO_PACKAGE) owner[hit.first] = hit.second;
+        }
+    }
+
+    std::vector<std::uint64_t> packageBytes(db.names.size());
+    std::vector<std::uint64_t> unowned(count);
+    for (std::uint32_t i = count; i-- > 1;) {
+        if (!tree.isFolder[i]) {
+            if (owner[i] != NO_PACKAGE) {
+                packageBytes[owner[i]] += tree.size[i];
+            } else {
+                unowned[i] = tree.size[i];
+            }
+        }
+        unowned[tree.parent[i]] += unowned[i];
+    }
+
+    std::vector<std::uint32_t> packages;
+    for (std::uint32_t p = 0; p < packageBytes.size(); ++p) {
+        if (packageBytes[p] > 0) packages.push_back(p);
+    }
+    std::sort(packages.begin(), packages.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return packageBytes[a] > packageBytes[b];
+    });
+
+    std::vector<std::uint32_t> folders = spreadFolders(tree, unowned);
+
+    std::uint64_t total = tree.size[0];
+    std::uint64_t owned = total - unowned[0];
+    std::cout << "\n============================================================\n";
+    std::cout << "  Disk usage by package (" << db.names.size() << " installed)\n";
+    std::cout << "============================================================\n";
+    std::cout << "\n  Owned by " << packages.size() << " packages: " << formatSize(owned);
+    if (total > 0) std::cout << " (" << (owned * 100 / total) << "%)";
+    std::cout << "    Not owned: " << formatSize(unowned[0]) << "\n";
+
+    std::cout << "\n  Largest packages\n";
+    for (std::size_t i = 0; i < packages.size() && i < PACKAGE_REPORT_ROWS; ++i) {
+        std::cout << "  " << std::setw(12) << formatSize(packageBytes[packages[i]]) << "  "
+                  << db.names[packages[i]] << "\n";
+    }
+    std::cout << "\n  Not owned by any package\n";
+    if (folders.empty()) std::cout << "  None\n";
+    for (std::size_t i = 0; i < folders.size() && i < PACKAGE_REPORT_ROWS; ++i) {
+        std::cout << "  " << std::setw(12) << formatSize(unowned[folders[i]]) << "  "
+                  << nodePath(tree, folders[i]) << "\n";
+    }
+    return true;
+}
+
+// ============================================================================
+// COMPRESSIBILITY SAMPLING (LZ estimate + zero blocks, under an I/O budget)
+// ============================================================================
+
+const std::uint32_t SAMPLE_BLOCK = 32 * 1024;
+const std::uint32_t ZERO_PAGE = 4096;
+// All sampling reads together, so a production disk barely notices
+const std::uint64_t SAMPLE_READ_RATE = 64ull * 1024 * 1024;    // bytes per second
+// Samples the kernel is asked to prefetch ahead of the paced reads
+const std::size_t SAMPLE_READAHEAD = 4;
+// Folders with fewer samples are too noisy to list
+const std::size_t SAMPLE_MIN_PER_FOLDER = 8;
+const std::size_t SAMPLE_REPORT_ROWS = 25;
+
+// Most bytes the sampling pass may read in total (--sample-budget)
+std::uint64_t sampleBudget = 64ull * 1024 * 1024;
+
+struct ContentSample {
+    std::uint32_t node;
+    std::uint64_t offset;
+    std::uint32_t length;
+    std::uint64_t weight;       // bytes of the tree this sample stands for
+};
+
+/**
+ * LZ4-style estimate of the compressed size: a 4-byte sequence seen
+ * before (found through a small hash table) starts a match that costs
+ * about 3 bytes however long it is; anything else is a literal byte.
+ */
+std::size_t estimateCompressed(const unsigned char* data, std::size_t length) {
+    std::array<std::uint32_t, 4096> table;      // last position + 1 of each hashed sequence
+    table.fill(0);
+    std::size_t cost = 0;
+    std::size_t i = 0;
+    while (i + 4 <= length) {
+        std::uint32_t word;
+        std::memcpy(&word, data + i, 4);
+        std::uint32_t slot = (word * 2654435761u) >> 20;
+        std::uint32_t candidate = table[slot];
+        table[slot] = static_cast<std::uint32_t>(i + 1);
+        if (candidate != 0 && std::memcmp(data + candidate - 1, data + i, 4) == 0) {
+            std::size_t from = candidate - 1;
+            std::size_t match = 4;
+            while (i + match < length && data[from + match] == data[i + match]) match++;
+            cost += 3;
+            i += match;
+        } else {
+            cost++;
+            i++;
+        }
+    }
+    return cost + (length - i);
+}
+
+/** Bytes in whole zero pages, the part a sparse copy wouldn't allocate */
+std::size_t countZeroPages(const unsigned char* data, std::size_t length) {
+    std::size_t zeros = 0;
+    for (std::size_t page = 0; page + ZERO_PAGE <= length; page += ZERO_PAGE) {
+        const unsigned char* p = data + page;
+        if (p[0] == 0 && std::memcmp(p, p + 1, ZERO_PAGE - 1) == 0) zeros += ZERO_PAGE;
+    }
+    return zeros;
+}
+
+/**
+ * Spreads reads over time: each read books its bytes at the shared rate
+ * and waits for its turn.
+ */
+class ReadPacer {
+public:
+    explicit ReadPacer(std::uint64_t bytesPerSecond) : rate(bytesPerSecond) {}
+
+    void wait(std::uint64_t bytes) {
+        std::chrono::steady_clock::time_point slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot = std::max(next, std::chrono::steady_clock::now());
+            next = slot + std::chrono::microseconds(bytes * 1000000 / rate);
+        }
+        std::this_thread::sleep_until(slot);
+    }
+
+private:
+    std::uint64_t rate;
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point next;
+};
+
+using SampleReader = std::function<void(std::size_t sample, const unsigned char* data, std::size_t length)>;
+
+/**
+ * Reads the samples first..last of one regular file, in offset order.
+ * On Linux the kernel is told about all of them up front so it can read
+ * ahead, and the pages are dropped afterwards so sampling doesn't evict
+ * the page cache. Returns false if the file can't be read.
+ */
+bool readFileSamples(const fs::path& path, const std::vector<ContentSample>& samples, std::size_t first,
+                     std::size_t last, ReadPacer& pacer, const SampleReader& consume) {
+    std::vector<unsigned char> buffer(SAMPLE_BLOCK);
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOFOLLOW | O_NOATIME);
+    if (fd < 0 && errno == EPERM) fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | O_NOFOLLOW);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    // Prefetch only a few samples ahead, so the disk sees the pacer's rate
+    auto advise = [&](std::size_t s, int advice) {
+        if (s < last) posix_fadvise(fd, static_cast<off_t>(samples[s].offset), samples[s].length, advice);
+    };
+    for (std::size_t s = first; s < first + SAMPLE_READAHEAD; ++s) advise(s, POSIX_FADV_WILLNEED);
+    bool ok = true;
+    for (std::size_t s = first; s < last && ok; ++s) {
+        pacer.wait(samples[s].length);
+        advise(s + SAMPLE_READAHEAD, POSIX_FADV_WILLNEED);
+        std::size_t got = 0;
+        while (got < samples[s].length) {
+            ssize_t n = pread(fd, buffer.data() + got, samples[s].length - got,
+                              static_cast<off_t>(samples[s].offset + got));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            got += static_cast<std::size_t>(n);
+        }
+        ok = got == samples[s].length;
+        if (ok) consume(s, buffer.data(), got);
+        advise(s, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+    return ok;
+#else
+    std::error_code ec;
+    if (!fs::is_regular_file(path, ec)) return false;
+    std::ifstream in(path, std::ios::binary);
+    for (std::size_t s = first; s < last && in; ++s) {
+        pacer.wait(samples[s].length);
+        in.seekg(static_cast<std::streamoff>(samples[s].offset));
+        in.read(reinterpret_cast<char*>(buffer.data()), samples[s].length);
+        if (static_cast<std::size_t>(in.gcount()) == samples[s].length) consume(s, buffer.data(), samples[s].length);
+    }
+    return static_cast<bool>(in);
+#endif
+}
+
+/**
+ * Picks what to read. Below the budget every block of every file is
+ * read. Above it, blocks are taken at a fixed stride through all file
+ * bytes laid end to end, so a file is sampled in proportion to its size
+ * and each block stands for one stride of data.
+ */
+std::vector<ContentSample> planSamples(const ScanTree& tree, std::uint64_t budget) {
+    std::uint64_t total = 0;
+    for (std::uint32_t i = 0; i < tree.count(); ++i) {
+        if (!tree.isFolder[i]) total += tree.size[i];
+    }
+
+    std::vector<ContentSample> samples;
+    if (total <= budget) {
+        for (std::uint32_t i = 0; i < tree.count(); ++i) {
+            if (tree.isFolder[i]) continue;
+            for (std::uint64_t offset = 0; offset < tree.size[i]; offset += SAMPLE_BLOCK) {
+                auto length = static_cast<std::uint32_t>(std::min<std::uint64_t>(SAMPLE_BLOCK, tree.size[i] - offset));
+                samples.push_back({i, offset, length, length});
+            }
+        }
+        return samples;
+    }
+
+    std::uint64_t stride = total / std::max<std::uint64_t>(1, budget / SAMPLE_BLOCK) + 1;
+    std::uint64_t next = mix64(total) % stride;     // same tree, same samples
+    std::uint64_t start = 0;
+    for (std::uint32_t i = 0; i < tree.count(); ++i) {
+        if (tree.isFolder[i]) continue;
+        std::uint64_t size = tree.size[i];
+        for (; next < start + size; next += stride) {
+            auto length = static_cast<std::uint32_t>(std::min<std::uint64_t>(SAMPLE_BLOCK, size));
+            std::uint64_t offset = std::min(next - start, size - length) / ZERO_PAGE * ZERO_PAGE;
+            if (!samples.empty() && samples.back().node == i && samples.back().offset == offset) {
+                samples.back().weight += stride;      // small file, hit again
+            } else {
+                samples.push_back({i, offset, length, stride});
+            }
+        }
+        start += size;
+    }
+    return samples;
+}
+
+/**
+ * Estimates what transparent compression and sparse files would save,
+ * per folder, from a sample of file contents read in parallel within
+ * --sample-budget bytes. Files that are already sparse don't count
+ * toward the zero-block savings.
+ */
+void printCompressibilityReport(const ScanTree& tree) {
+    std::vector<ContentSample> samples = planSamples(tree, sampleBudget);
+    std::vector<std::size_t> files;     // first sample of each file; samples are grouped by file
+    for (std::size_t s = 0; s < samples.size(); ++s) {
+        if (s == 0 || samples[s].node != samples[s - 1].node) files.push_back(s);
+    }
+    files.push_back(samples.size());
+
+    std::uint64_t planned = 0;
+    for (const ContentSample& sample : samples) planned += sample.length;
+    std::cout << "\n  Sampling " << samples.size() << " blocks (" << formatSize(planned) << " to read)...\n";
+
+    std::vector<std::uint32_t> compressed(samples.size());
+    std::vector<std::uint32_t> zeros(samples.size());
+    std::vector<char> read(samples.size(), 0);
+    ReadPacer pacer(SAMPLE_READ_RATE);
+    std::atomic<std::size_t> next{0};
+    std::size_t workers = std::min<std::size_t>(files.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::future<void>> pool;
+    for (std::size_t w = 0; w < workers; ++w) {
+        pool.push_back(std::async(std::launch::async, [&]() {
+            for (std::size_t f; (f = next++) + 1 < files.size();) {
+                std::uint32_t node = samples[files[f]].node;
+                readFileSamples(nodePath(tree, node), samples, files[f], files[f + 1], pacer,
+                                [&](std::size_t s, const unsigned char* data, std::size_t length) {
+                    compressed[s] = static_cast<std::uint32_t>(estimateCompressed(data, length));
+                    zeros[s] = static_cast<std::uint32_t>(countZeroPages(data, length));
+                    read[s] = 1;
+                });
+            }
+        }));
+    }
+    for (auto& worker : pool) worker.get();
+
+    const std::uint32_t count = tree.count();
+    std::vector<std::uint64_t> compressSaved(count);
+    std::vector<std::uint64_t> zeroSaved(count);
+    std::vector<std::uint64_t> sampled(count);
+    std::uint64_t bytesRead = 0;
+    for (std::size_t s = 0; s < samples.size(); ++s) {
+        if (!read[s]) continue;
+        const ContentSample& sample = samples[s];
+        double scale = static_cast<double>(sample.weight) / sample.length;
+        compressSaved[sample.node] += static_cast<std::uint64_t>(
+            (sample.length - std::min(sample.length, compressed[s])) * scale);
+        if (tree.alloc[sample.node] >= tree.size[sample.node]) {
+            zeroSaved[sample.node] += static_cast<std::uint64_t>(zeros[s] * scale);
+        }
+        sampled[sample.node]++;
+        bytesRead += sample.length;
+    }
+    for (std::uint32_t i = count; i-- > 1;) {
+        compressSaved[tree.parent[i]] += compressSaved[i];
+        zeroSaved[tree.parent[i]] += zeroSaved[i];
+        sampled[tree.parent[i]] += sampled[i];
+    }
+
+    std::vector<std::uint64_t> saved(count);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        saved[i] = sampled[i] >= SAMPLE_MIN_PER_FOLDER ? compressSaved[i] + zeroSaved[i] : 0;
+    }
+    std::vector<std::uint32_t> folders = spreadFolders(tree, saved);
+
+    std::uint64_t total = tree.size[0];
+    std::cout << "\n============================================================\n";
+    std::cout << "  Compressibility (" << sampled[0] << " samples, " << formatSize(bytesRead) << " read)\n";
+    std::cout << "============================================================\n";
+    std::cout << "\n  Compression would save ~" << formatSize(compressSaved[0]);
+    if (total > 0) std::cout << " (" << (compressSaved[0] * 100 / total) << "% of " << formatSize(total) << ")";
+    std::cout << "    Zero blocks: ~" << formatSize(zeroSaved[0]) << "\n";
+
+    std::cout << "\n      compress         zeros  samples  folder\n";
+    if (folders.empty()) std::cout << "  None\n";
+    for (std::size_t i = 0; i < folders.size() && i < SAMPLE_REPORT_ROWS; ++i) {
+        std::uint32_t folder = folders[i];
+        std::cout << "  " << std::setw(12) << formatSize(compressSaved[folder])
+                  << "  " << std::setw(12) << formatSize(zeroSaved[folder])
+                  << "  " << std::setw(7) << sampled[folder] << "  " << nodePath(tree, folder) << "\n";
+    }
+}
+
+// ============================================================================
+// LIVE TREE (watch mode)
+// ============================================================================
+
+/**
+ * One version of a file or folder. Published nodes are never modified:
+ * an update copies the nodes from the change up to the root and then
+ * publishes the new root, so readers never take a lock.
+ */
+struct LiveNode {
+    std::string name;
+    std::uintmax_t size = 0;                  // total for folders
+    std::uintmax_t alloc = 0;                 // totalled like size
+    std::int64_t mtime = 0;
+    std::uint32_t uid = 0;
+    bool isFolder = false;
+    std::vector<const LiveNode*> children;    // sorted by name, shared between versions
+};
+
+/**
+ * Epoch-based reclamation for replaced LiveNodes. A reader stores the
+ * epoch it entered in; a node retired in epoch E is only freed once no
+ * reader is still in E or earlier.
+ */
+class EpochDomain {
+public:
+    static constexpr std::uint64_t IDLE = ~0ull;
+
+    struct Slot {
+        std::atomic<std::uint64_t> epoch{IDLE};
+    };
+
+    // Once per reader thread
+    Slot& registerReader() {
+        std::lock_guard<std::mutex> lock(slotsMutex);
+        return slots.emplace_back();
+    }
+
+    void enter(Slot& slot) { slot.epoch.store(epoch.load()); }
+    void exit(Slot& slot) { slot.epoch.store(IDLE, std::memory_order_release); }
+
+    // Writer only
+    void retire(const LiveNode* node) {
+        retired.push_back({node, epoch.load(std::memory_order_relaxed)});
+    }
+
+    // Writer only, after publishing: frees what no reader can still see
+    void reclaim() {
+        epoch.fetch_add(1);
+        std::uint64_t oldest = IDLE;
+        {
+            std::lock_guard<std::mutex> lock(slotsMutex);
+            for (const auto& slot : slots) oldest = std::min(oldest, slot.epoch.load());
+        }
+        auto firstKept = std::partition(retired.begin(), retired.end(),
+            [oldest](const auto& r) { return r.second < oldest; });
+        for (auto it = retired.begin(); it != firstKept; ++it) delete it->first;
+        retired.erase(retired.begin(), firstKept);
+    }
+
+    std::size_t pending() const { return retired.size(); }
+
+    ~EpochDomain() {
+        for (const auto& r : retired) delete r.first;
+    }
+
+private:
+    std::atomic<std::uint64_t> epoch{1};
+    std::mutex slotsMutex;
+    std::deque<Slot> slots;
+    std::vector<std::pair<const LiveNode*, std::uint64_t>> retired;
+};
+
+void freeLiveSubtree(const LiveNode* node) {
+    for (const LiveNode* child : node->children) freeLiveSubtree(child);
+    delete node;
+}
+
+/**
+ * Converts a finalized ScanTree subtree into live nodes.
+ */
+const LiveNode* liveFromTree(const ScanTree& tree, std::uint32_t node) {
+    auto live = new LiveNode();
+    live->name = std::string(tree.name(node));
+    live->size = tree.size[node];
+    live->alloc = tree.alloc[node];
+    live->mtime = tree.mtime[node];
+    live->uid = tree.uid[node];
+    live->isFolder = tree.isFolder[node] != 0;
+    for (std::uint32_t c = node + 1; c < tree.subtreeEnd[node]; c = tree.subtreeEnd[c]) {
+        live->children.push_back(liveFromTree(tree, c));
+    }
+    std::sort(live->children.begin(), live->children.end(),
+        [](const LiveNode* a, const LiveNode* b) { return a->name < b->name; });
+    return live;
+}
+
+/**
+ * The current tree plus its old versions still in use. One updater
+ * thread calls apply(); any number of readers use a Reader.
+ */
+class LiveTree {
+public:
+    explicit LiveTree(const LiveNode* initial) : root(initial) {}
+
+    ~LiveTree() {
+        freeLiveSubtree(root.load());
+    }
+
+    // Pins one consistent version for as long as it lives
+    class Reader {
+    public:
+        Reader(LiveTree& tree, EpochDomain::Slot& slot) : tree(tree), slot(slot) {
+            tree.epochs.enter(slot);
+            root = tree.root.load();
+        }
+        ~Reader() { tree.epochs.exit(slot); }
+
+        const LiveNode* root;
+
+    private:
+        LiveTree& tree;
+        EpochDomain::Slot& slot;
+    };
+
+    EpochDomain::Slot& registerReader() { return epochs.registerReader(); }
+
+    std::uint64_t version() const { return versions.load(std::memory_order_relaxed); }
+
+    /**
+     * Sets the entry at relPath ("a/b/c") to `replacement`, or removes it
+     * when replacement is nullptr. Changes below unknown folders are
+     * dropped. Takes ownership of replacement. Returns the change in
+     * total size.
+     */
+    std::int64_t apply(const std::string& relPath, const LiveNode* replacement) {
+        if (relPath.find_first_not_of('/') == std::string::npos) {
+            if (replacement) freeLiveSubtree(replacement);
+            return 0;   // the root itself is never replaced
+        }
+        bool used = false;
+        std::int64_t change = update(relPath, [&](const LiveNode* old) {
+            if (!old && !replacement) return old;
+            if (old) retireSubtree(old);
+            used = true;
+            return replacement;
+        });
+        if (!used && replacement) freeLiveSubtree(replacement);
+        return change;
+    }
+
+    /**
+     * Several changes to the entries of one folder (name -> replacement,
+     * nullptr removes). The folder and its ancestors are copied once, not
+     * once per entry. Takes ownership of the replacements. Returns the
+     * change in total size.
+     */
+    std::int64_t applyBatch(const std::string& folderPath,
+                            std::vector<std::pair<std::string, const LiveNode*>> changes) {
+        std::sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        bool used = false;
+        std::int64_t change = update(folderPath, [&](const LiveNode* old) -> const LiveNode* {
+            if (!old || !old->isFolder) return old;
+            used = true;
+            auto copy = new LiveNode(*old);
+            copy->children.clear();
+            auto add = [copy](const LiveNode* node) {
+                copy->children.push_back(node);
+                copy->size += node->size;
+                copy->alloc += node->alloc;
+            };
+            // Both sides sorted by name: one merge
+            auto next = changes.begin();
+            for (const LiveNode* child : old->children) {
+                for (; next != changes.end() && next->first < child->name; ++next) {
+                    if (next->second) add(next->second);
+                }
+                if (next != changes.end() && next->first == child->name) {
+                    copy->size -= child->size;
+                    copy->alloc -= child->alloc;
+                    retireSubtree(child);
+                    if (next->second) add(next->second);
+                    ++next;
+                } else {
+                    copy->children.push_back(child);
+                }
+            }
+            for (; next != changes.end(); ++next) {
+                if (next->second) add(next->second);
+            }
+            epochs.retire(old);
+            return copy;
+        });
+        if (!used) {
+            for (const auto& entry : changes) {
+                if (entry.second) freeLiveSubtree(entry.second);
+            }
+        }
+        return change;
+    }
+
+    // Sets a folder's own mtime, keeping its contents ("" = the root)
+    void touch(const std::string& relPath, std::int64_t mtime) {
+        update(relPath, [&](const LiveNode* old) {
+            if (!old || !old->isFolder || old->mtime == mtime) return old;
+            auto copy = new LiveNode(*old);
+            copy->mtime = mtime;
+            epochs.retire(old);
+            return static_cast<const LiveNode*>(copy);
+        });
+    }
+
+    // The latest version. Only for the updater thread, which is the
+    // only one that can retire it.
+    const LiveNode* current() const { return root.load(std::memory_order_relaxed); }
+
+    // Call after a batch of apply() to free versions no reader holds
+    void reclaim() { epochs.reclaim(); }
+
+private:
+    std::atomic<const LiveNode*> root;
+    std::atomic<std::uint64_t> versions{1};
+    EpochDomain epochs;
+
+    void retireSubtree(const LiveNode* node) {
+        for (const LiveNode* child : node->children) retireSubtree(child);
+        epochs.retire(node);
+    }
+
+    using Change = std::function<const LiveNode*(const LiveNode*)>;
+
+    // Replaces the entry at relPath with change(old entry or nullptr),
+    // publishes the result and returns the change in total size
+    std::int64_t update(const std::string& relPath, const Change& change) {
+        std::vector<std::string> parts;
+        std::istringstream stream(relPath);
+        for (std::string part; std::getline(stream, part, '/');) {
+            if (!part.empty()) parts.push_back(part);
+        }
+
+        const LiveNode* current = root.load(std::memory_order_relaxed);
+        const LiveNode* next = parts.empty() ? change(current) : rewrite(current, parts, 0, change);
+        if (!next || next == current) return 0;
+        root.store(next);
+        versions.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<std::int64_t>(next->size - current->size);
+    }
+
+    // New version of `node` with the change applied, or `node` if nothing changed
+    const LiveNode* rewrite(const LiveNode* node, const std::vector<std::string>& parts,
+                            std::size_t depth, const Change& change) {
+        auto it = std::lower_bound(node->children.begin(), node->children.end(), parts[depth],
+            [](const LiveNode* child, const std::string& name) { return child->name < name; });
+        const LiveNode* oldChild = (it != node->children.end() && (*it)->name == parts[depth]) ? *it : nullptr;
+
+        const LiveNode* newChild;
+        if (depth + 1 == parts.size()) {
+            newChild = change(oldChild);
+            if (newChild == oldChild) return node;
+        } else {
+            if (!oldChild || !oldChild->isFolder) return node;
+            newChild = rewrite(oldChild, parts, depth + 1, change);
+            if (newChild == oldChild) return node;
+        }
+
+        auto copy = new LiveNode(*node);
+        auto pos = copy->children.begin() + (it - node->children.begin());
+        if (oldChild && newChild) *pos = newChild;
+        else if (oldChild) copy->children.erase(pos);
+        else copy->children.insert(pos, newChild);
+        copy->size = node->size - (oldChild ? oldChild->size : 0) + (newChild ? newChild->size : 0);
+        copy->alloc = node->alloc - (oldChild ? oldChild->alloc : 0) + (newChild ? newChild->alloc : 0);
+        epochs.retire(node);
+        return copy;
+    }
+};
+
+/**
+ * Exponentially decayed growth rate (bytes/s) of every folder that
+ * changed recently, each change counted in all its ancestors too.
+ * Owned by the updater thread; readers get published top lists.
+ */
+class WriteRates {
+public:
+    struct Entry {
+        std::string folder;     // relative to the root, "" = root
+        double rate;
+    };
+    using Board = std::vector<Entry>;
+
+    static constexpr double TIME_CONSTANT = 5.0;     // seconds
+
+    void add(std::string folder, double bytes, double now) {
+        while (true) {
+            Rate& r = rates[folder];
+            r.value = decayed(r, now) + bytes;
+            r.at = now;
+            if (folder.empty()) break;
+            std::size_t slash = folder.rfind('/');
+            folder.erase(slash == std::string::npos ? 0 : slash);
+        }
+    }
+
+    // Fastest growing folders right now; forgets folders that went quiet
+    std::shared_ptr<const Board> top(std::size_t n, double now) {
+        auto board = std::make_shared<Board>();
+        for (auto it = rates.begin(); it != rates.end();) {
+            double value = decayed(it->second, now);
+            if (std::abs(value) < 1.0) {
+                it = rates.erase(it);
+                continue;
+            }
+            if (value > 0) board->push_back({it->first, value / TIME_CONSTANT});
+            ++it;
+        }
+        std::sort(board->begin(), board->end(), [](const Entry& a, const Entry& b) { return a.rate > b.rate; });
+        if (board->size() > n) board->resize(n);
+        return board;
+    }
+
+private:
+    struct Rate {
+        double value = 0;       // decayed bytes
+        double at = 0;
+    };
+    std::unordered_map<std::string, Rate> rates;
+
+    static double decayed(const Rate& r, double now) {
+        return r.value * std::exp(-(now - r.at) / TIME_CONSTANT);
+    }
+};
+
+double secondsNow() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Rebuilds a finalized ScanTree from a live version (for snapshots).
+ */
+ScanTree treeFromLive(const LiveNode* root, const fs::path& rootPath) {
+    ScanTree tree;
+    tree.rootPath = rootPath;
+    std::vector<std::pair<const LiveNode*, std::uint32_t>> stack{{root, NO_NODE}};
+    while (!stack.empty()) {
+        auto [node, parent] = stack.back();
+        stack.pop_back();
+        EntryInfo info;
+        info.size = node->size;
+        info.alloc = node->alloc;
+        info.mtime = node->mtime;
+        info.uid = node->uid;
+        std::uint32_t index = tree.addNode(parent, parent == NO_NODE ? rootPath.u8string() : node->name,
+                                           info, node->isFolder);
+        for (const LiveNode* child : node->children) stack.push_back({child, index});
+    }
+    finalizeTree(tree);
+    return tree;
+}
+
+#ifdef __linux__
+/**
+ * Log of LiveTree changes since the last state snapshot. Records are
+ * buffered and written with one write + fdatasync per event batch
+ * (group commit). Each has a length and checksum, so a torn tail from
+ * a crash is just ignored on replay. All records are idempotent.
+ */
+class WriteAheadLog {
+public:
+    enum Op : std::uint8_t { PUT = 1, REMOVE = 2, TOUCH = 3 };
+
+    ~WriteAheadLog() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool open(const fs::path& file) {
+        fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) return false;
+        written = static_cast<std::uint64_t>(lseek(fd, 0, SEEK_END));
+        return true;
+    }
+
+    void logPut(const std::string& rel, const LiveNode* node) {
+        std::string payload = header(PUT, rel);
+        encode(payload, node);
+        append(payload);
+    }
+
+    void logRemove(const std::string& rel) {
+        append(header(REMOVE, rel));
+    }
+
+    void logTouch(const std::string& rel, std::int64_t mtime) {
+        std::string payload = header(TOUCH, rel);
+        appendPod(payload, mtime);
+        append(payload);
+    }
+
+    // Makes everything logged so far durable
+    bool commit() {
+        if (pending.empty()) return true;
+        const char* data = pending.data();
+        std::size_t left = pending.size();
+        while (left > 0) {
+            ssize_t n = write(fd, data, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            left -= static_cast<std::size_t>(n);
+        }
+        written += pending.size();
+        pending.clear();
+        return fdatasync(fd) == 0;
+    }
+
+    // After compaction: the snapshot now holds everything
+    bool reset() {
+        pending.clear();
+        written = 0;
+        return ftruncate(fd, 0) == 0 && fdatasync(fd) == 0;
+    }
+
+    std::uint64_t size() const { return written + pending.size(); }
+
+    /**
+     * Re-applies a log to `tree`, stopping at the first torn or damaged
+     * record. Returns the number of records applied.
+     */
+    static std::uint64_t replay(const fs::path& file, LiveTree& tree) {
+        std::ifstream in(file, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::uint64_t applied = 0;
+        for (std::size_t pos = 0; pos + 8 <= data.size();) {
+            std::uint32_t length, sum;
+            std::memcpy(&length, &data[pos], 4);
+            std::memcpy(&sum, &data[pos + 4], 4);
+            if (length > data.size() - pos - 8 || checksum(&data[pos + 8], length) != sum) break;
+
+            Reader reader{&data[pos + 8], &data[pos + 8] + length};
+            auto op = reader.pod<std::uint8_t>();
+            std::string rel = reader.text();
+            if (op == PUT) {
+                const LiveNode* node = reader.node(0);
+                if (!node) break;
+                tree.apply(rel, node);
+            } else if (op == REMOVE) {
+                tree.apply(rel, nullptr);
+            } else if (op == TOUCH) {
+                tree.touch(rel, reader.pod<std::int64_t>());
+            }
+            if (!reader.ok) break;
+            applied++;
+            pos += 8 + length;
+        }
+        tree.reclaim();
+        return applied;
+    }
+
+private:
+    int fd = -1;
+    std::uint64_t written = 0;
+    std::string pending;
+
+    // Bounds-checked decoding of one record's payload
+    struct Reader {
+        const char* p;
+        const char* end;
+        bool ok = true;
+
+        template <typename T>
+        T pod() {
+            T value{};
+            if (static_cast<std::size_t>(end - p) < sizeof(T)) {
+                ok = false;
+                return value;
+            }
+            std::memcpy(&value, p, sizeof(T));
+            p += sizeof(T);
+            return value;
+        }
+
+        std::string text() {
+            auto length = pod<std::uint32_t>();
+            if (!ok || static_cast<std::size_t>(end - p) < length) {
+                ok = false;
+                return std::string();
+            }
+            std::string s(p, length);
+            p += length;
+            return s;
+        }
+
+        const LiveNode* node(int depth) {
+            if (depth > 4096) ok = false;
+            auto live = new LiveNode();
+            live->name = text();
+            live->size = pod<std::uint64_t>();
+            live->alloc = pod<std::uint64_t>();
+            live->mtime = pod<std::int64_t>();
+            live->uid = pod<std::uint32_t>();
+            live->isFolder = pod<std::uint8_t>() != 0;
+            auto children = pod<std::uint32_t>();
+            for (std::uint32_t c = 0; ok && c < children; ++c) {
+                const LiveNode* child = node(depth + 1);
+                if (child) live->children.push_back(child);
+            }
+            if (!ok) {
+                freeLiveSubtree(live);
+                return nullptr;
+            }
+            return live;
+        }
+    };
+
+    static std::uint32_t checksum(const char* data, std::size_t length) {
+        std::uint32_t h = 2166136261u;      // FNV-1a
+        for (std::size_t i = 0; i < length; ++i) {
+            h = (h ^ static_cast<std::uint8_t>(data[i])) * 16777619u;
+        }
+        return h;
+    }
+
+    static std::string header(Op op, const std::string& rel) {
+        std::string payload;
+        appendPod(payload, static_cast<std::uint8_t>(op));
+        appendPod(payload, static_cast<std::uint32_t>(rel.size()));
+        payload += rel;
+        return payload;
+    }
+
+    static void encode(std::string& out, const LiveNode* node) {
+        appendPod(out, static_cast<std::uint32_t>(node->name.size()));
+        out += node->name;
+        appendPod(out, static_cast<std::uint64_t>(node->size));
+        appendPod(out, static_cast<std::uint64_t>(node->alloc));
+        appendPod(out, node->mtime);
+        appendPod(out, node->uid);
+        appendPod(out, static_cast<std::uint8_t>(node->isFolder ? 1 : 0));
+        appendPod(out, static_cast<std::uint32_t>(node->children.size()));
+        for (const LiveNode* child : node->children) encode(out, child);
+    }
+
+    void append(const std::string& payload) {
+        appendPod(pending, static_cast<std::uint32_t>(payload.size()));
+        appendPod(pending, checksum(payload.data(), payload.size()));
+        pending += payload;
+    }
+};
+
+/**
+ * Feeds inotify events for every folder under root into a LiveTree.
+ * Events are only noted as they arrive, folded per folder and entry;
+ * a short window later each touched entry is statted once and every
+ * folder's changes go into the tree as one batch. When the kernel
+ * queue overflows, the tree is rechecked by folder mtime instead.
+ */
+class TreeWatcher {
+public:
+    TreeWatcher(const fs::path& root, LiveTree& tree) : rootPath(root), tree(tree) {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+
+    ~TreeWatcher() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool ok() const { return fd >= 0; }
+
+    // Keeps `wal` and periodic snapshots in stateFile up to date
+    void setState(const fs::path& file, WriteAheadLog* log) {
+        stateFile = file;
+        wal = log;
+    }
+
+    // Watches every folder of a live subtree found at relBase
+    void watchLive(const LiveNode* node, const std::string& relBase) {
+        if (!node->isFolder) return;
+        fs::path full = relBase.empty() ? rootPath : rootPath / fs::u8path(relBase);
+        int wd = inotify_add_watch(fd, full.c_str(), WATCH_MASK);
+        if (wd >= 0) dirs[wd] = relBase;
+        for (const LiveNode* child : node->children) {
+            watchLive(child, relBase.empty() ? child->name : relBase + "/" + child->name);
+        }
+    }
+
+    /**
+     * After loading saved state: rescans the folders whose mtime moved
+     * while nobody was watching. Returns how many were rescanned.
+     */
+    std::uint64_t revalidate() {
+        if (!slot) slot = &tree.registerReader();   // also called after every overflow
+        LiveTree::Reader reader(tree, *slot);
+        std::uint64_t rescanned = 0;
+        revalidateFolder(reader.root, "", rescanned);
+        if (wal) wal->commit();
+        return rescanned;
+    }
+
+    // Writes the current version as the state snapshot and empties the log
+    bool compact() {
+        if (!wal) return true;
+        ScanTree snapshot = treeFromLive(tree.current(), rootPath);
+        snapshot.scannedAt = static_cast<std::int64_t>(std::time(nullptr));
+        fs::path temp = stateFile;
+        temp += ".tmp";
+        std::error_code ec;
+        if (!wal->commit() || !writeSnapshot(snapshot, temp, false)) return false;
+        fs::rename(temp, stateFile, ec);
+        lastCompaction = secondsNow();
+        return !ec && wal->reset();
+    }
+
+    // Watches every folder of a scanned subtree found at relBase
+    void watchTree(const ScanTree& sub, const std::string& relBase) {
+        std::vector<std::string> rel(sub.count());
+        for (std::uint32_t i = 0; i < sub.count(); ++i) {
+            if (i == 0) rel[i] = relBase;
+            else rel[i] = rel[sub.parent[i]].empty() ? std::string(sub.name(i))
+                                                     : rel[sub.parent[i]] + "/" + std::string(sub.name(i));
+            if (!sub.isFolder[i]) continue;
+
+            fs::path full = rel[i].empty() ? rootPath : rootPath / fs::u8path(rel[i]);
+            int wd = inotify_add_watch(fd, full.c_str(), WATCH_MASK);
+            if (wd >= 0) dirs[wd] = rel[i];
+        }
+    }
+
+    // Fastest growing folders, republished every second
+    std::shared_ptr<const WriteRates::Board> leaderboard() const {
+        return std::atomic_load(&board);
+    }
+
+    // Applies events until `stop` is set
+    void run(const std::atomic<bool>& stop) {
+        alignas(inotify_event) char buffer[64 * 1024];
+        double lastBoard = 0;
+        growth.clear();         // startup checks aren't growth
+        while (!stop) {
+            // Wake up when the open window closes at the latest
+            int timeout = 200;
+            if (!pending.empty()) {
+                double left = windowStart + COALESCE_SECONDS - secondsNow();
+                timeout = std::max(0, std::min(timeout, static_cast<int>(left * 1000)));
+            }
+            pollfd pfd{fd, POLLIN, 0};
+            if (poll(&pfd, 1, timeout) > 0) {
+                // Stop reading at the cap: the rest waits in the kernel queue
+                ssize_t length;
+                while (pendingNames < MAX_PENDING_NAMES && (length = read(fd, buffer, sizeof(buffer))) > 0) {
+                    for (char* p = buffer; p < buffer + length;) {
+                        auto event = reinterpret_cast<const inotify_event*>(p);
+                        handle(*event);
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+
+            double now = secondsNow();
+            bool rescanDue = overflowed && now - lastOverflowRescan >= OVERFLOW_RESCAN_SECONDS;
+            if (rescanDue || (!pending.empty() &&
+                              (now - windowStart >= COALESCE_SECONDS || pendingNames >= MAX_PENDING_NAMES))) {
+                flush(rescanDue);
+            }
+
+            // One rate update per folder per batch, however many events hit it
+            now = secondsNow();
+            if (wal && (wal->size() > WAL_COMPACT_BYTES ||
+                        (wal->size() > 0 && now - lastCompaction > COMPACT_SECONDS))) {
+                compact();
+            }
+            for (const auto& change : growth) rates.add(change.first, static_cast<double>(change.second), now);
+            growth.clear();
+            if (now - lastBoard >= 1.0) {
+                std::atomic_store(&board, rates.top(LEADERBOARD_SIZE, now));
+                lastBoard = now;
+            }
+        }
+
+        // Nothing noted may be left out of the final state
+        if (!pending.empty() || overflowed) {
+            flush(overflowed);
+        }
+    }
+
+private:
+    static constexpr std::uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE |
+                                                IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+    static const std::size_t LEADERBOARD_SIZE = 20;
+    static constexpr double COALESCE_SECONDS = 0.25;        // events are collected this long
+    static const std::size_t RELIST_NAMES = 1024;           // more in one folder: list it instead
+    static const std::size_t MAX_PENDING_NAMES = 1 << 16;   // flush early beyond this many
+    static constexpr double OVERFLOW_RESCAN_SECONDS = 5;    // at most one full mtime check per this
+    static const std::uint64_t WAL_COMPACT_BYTES = 64ull << 20;
+    static constexpr double COMPACT_SECONDS = 600;
+
+    fs::path rootPath;
+    LiveTree& tree;
+    fs::path stateFile;
+    WriteAheadLog* wal = nullptr;
+    double lastCompaction = secondsNow();
+    int fd = -1;
+    std::map<int, std::string> dirs;    // watch descriptor -> folder relative to root
+    std::unordered_map<std::string, std::int64_t> growth;   // size change per folder, this batch
+    std::unordered_set<std::string> changedFolders;         // entries added or removed, this batch
+
+    // Events noted since the window opened, per folder
+    struct PendingFolder {
+        std::unordered_map<std::string, std::uint32_t> names;  // entry -> all its event bits
+        bool relist = false;                                   // too many names: list the folder
+    };
+    std::unordered_map<std::string, PendingFolder> pending;
+    std::size_t pendingNames = 0;
+    double windowStart = 0;
+    bool overflowed = false;                // the kernel dropped events
+    double lastOverflowRescan = 0;
+    EpochDomain::Slot* slot = nullptr;
+    std::unordered_set<std::string> racyFolders;    // mtime recorded within its own second
+    WriteRates rates;
+    std::shared_ptr<const WriteRates::Board> board = std::make_shared<WriteRates::Board>();
+
+    void handle(const inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            overflowed = true;
+            return;
+        }
+        if (event.mask & IN_IGNORED) {
+            dirs.erase(event.wd);
+            return;
+        }
+        auto dir = dirs.find(event.wd);
+        if (dir == dirs.end() || event.len == 0) return;
+
+        if (pending.empty()) windowStart = secondsNow();
+        PendingFolder& folder = pending[dir->second];
+        if (folder.relist) return;
+        auto noted = folder.names.emplace(event.name, 0);
+        noted.first->second |= event.mask;
+        if (noted.second) pendingNames++;
+        if (folder.names.size() > RELIST_NAMES) {
+            pendingNames -= folder.names.size();
+            folder.names.clear();
+            folder.relist = true;
+        }
+    }
+
+    /**
+     * Applies everything noted in the window, one batch per folder, and
+     * with `rescan` (after an overflow) checks the whole tree by mtime.
+     */
+    void flush(bool rescan) {
+        // Parents first, so folders removed in this batch are skipped below
+        std::vector<std::string> folders;
+        folders.reserve(pending.size());
+        for (const auto& entry : pending) folders.push_back(entry.first);
+        std::sort(folders.begin(), folders.end());
+        for (const auto& rel : folders) {
+            flushFolder(rel, pending[rel], rescan);
+        }
+        pending.clear();
+        pendingNames = 0;
+
+        if (rescan) {
+            overflowed = false;
+            lastOverflowRescan = secondsNow();
+            revalidate();
+        }
+
+        if (wal) {
+            // Folder mtimes too, so a restart knows these are current
+            for (const auto& rel : changedFolders) {
+                EntryInfo info;
+                fs::path full = rel.empty() ? rootPath : rootPath / fs::u8path(rel);
+                if (fsBackend->stat(full, info) != FsResult::Ok) continue;
+                recordMtime(rel, info.mtime);
+            }
+            wal->commit();          // group commit: one sync per batch
+        }
+        changedFolders.clear();
+        tree.reclaim();
+    }
+
+    // Stats each noted entry of one folder once and applies the result
+    void flushFolder(const std::string& rel, const PendingFolder& noted, bool rescan) {
+        const LiveNode* folder = findLive(rel);
+        if (!folder || !folder->isFolder) return;
+        fs::path full = rel.empty() ? rootPath : rootPath / fs::u8path(rel);
+
+        // Events were lost: the folders that saw some get a full listing
+        if (noted.relist || rescan) {
+            growth[rel] += relistFolder(folder, rel, nullptr);
+            changedFolders.insert(rel);
+            return;
+        }
+
+        std::vector<std::pair<std::string, const LiveNode*>> changes;
+        for (const auto& entry : noted.names) {
+            const std::string& name = entry.first;
+            std::uint32_t mask = entry.second;
+            const LiveNode* known = childNamed(folder, name);
+            std::string childRel = rel.empty() ? name : rel + "/" + name;
+            if (mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) {
+                changedFolders.insert(rel);
+            }
+
+            // Symlinks (without --follow), FIFOs and sockets aren't counted, as in list()
+            EntryInfo info;
+            if (fsBackend->stat(full / fs::u8path(name), info) != FsResult::Ok || info.type == EntryType::Other) {
+                if (known) changes.push_back({name, nullptr});
+            } else if (info.type == EntryType::Folder) {
+                // Changes inside a known folder come from its own watch
+                if (known && known->isFolder && !(mask & (IN_CREATE | IN_MOVED_TO))) continue;
+                changes.push_back({name, scanFolder(name, full / fs::u8path(name), childRel)});
+            } else if (!known || known->isFolder || known->size != info.size ||
+                       known->alloc != info.alloc || known->mtime != info.mtime) {
+                changes.push_back({name, fileNode(name, info)});
+            }
+        }
+        growth[rel] += applyChanges(rel, std::move(changes));
+    }
+
+    // Entry of the latest version at rel (updater thread only)
+    const LiveNode* findLive(const std::string& rel) const {
+        const LiveNode* node = tree.current();
+        std::istringstream stream(rel);
+        for (std::string part; node && std::getline(stream, part, '/');) {
+            if (!part.empty()) node = childNamed(node, part);
+        }
+        return node;
+    }
+
+    static const LiveNode* childNamed(const LiveNode* folder, const std::string& name) {
+        auto it = std::lower_bound(folder->children.begin(), folder->children.end(), name,
+            [](const LiveNode* child, const std::string& n) { return child->name < n; });
+        return (it != folder->children.end() && (*it)->name == name) ? *it : nullptr;
+    }
+
+    // Logs the changes to one folder's entries, then applies them together
+    std::int64_t applyChanges(const std::string& rel, std::vector<std::pair<std::string, const LiveNode*>> changes) {
+        if (changes.empty()) return 0;
+        if (wal) {
+            for (const auto& change : changes) {
+                std::string childRel = rel.empty() ? change.first : rel + "/" + change.first;
+                if (change.second) wal->logPut(childRel, change.second);
+                else wal->logRemove(childRel);
+            }
+        }
+        return tree.applyBatch(rel, std::move(changes));
+    }
+
+    static const LiveNode* fileNode(const std::string& name, const EntryInfo& info) {
+        auto file = new LiveNode();
+        file->name = name;
+        file->size = info.size;
+        file->alloc = info.alloc;
+        file->mtime = info.mtime;
+        file->uid = info.uid;
+        return file;
+    }
+
+    // New or moved-in folder: scan it whole and watch it
+    const LiveNode* scanFolder(const std::string& name, const fs::path& full, const std::string& rel) {
+        ScanTree sub;
+        addFolderNode(sub, NO_NODE, name, full);
+        scanIntoTree(sub, 0, full);
+        finalizeTree(sub);
+        watchTree(sub, rel);
+        return liveFromTree(sub, 0);
+    }
+
+    /**
+     * Lists `folder` again and applies the differences. Subfolders that
+     * are already known go to `unchangedFolders` (if given) rather than
+     * being rescanned. Returns the change in size.
+     */
+    std::int64_t relistFolder(const LiveNode* folder, const std::string& rel,
+                              std::vector<const LiveNode*>* unchangedFolders) {
+        fs::path full = rel.empty() ? rootPath : rootPath / fs::u8path(rel);
+        auto childRel = [&rel](const std::string& name) { return rel.empty() ? name : rel + "/" + name; };
+
+        EntryInfo folderInfo;
+        std::vector<DirEntry> entries;
+        if (fsBackend->stat(full, folderInfo) != FsResult::Ok || fsBackend->list(full, entries) != FsResult::Ok) {
+            return 0;
+        }
+
+        std::vector<std::pair<std::string, const LiveNode*>> changes;
+        std::unordered_set<std::string> present;
+        for (const auto& entry : entries) {
+            if (entry.type == EntryType::Other) continue;
+            present.insert(entry.name);
+            const LiveNode* known = childNamed(folder, entry.name);
+            if (entry.type == EntryType::Folder) {
+                if (!known || !known->isFolder) {
+                    changes.push_back({entry.name, scanFolder(entry.name, entry.path, childRel(entry.name))});
+                } else if (unchangedFolders) {
+                    unchangedFolders->push_back(known);
+                }
+            } else {
+                EntryInfo info;
+                if (fsBackend->stat(entry.path, info) != FsResult::Ok) continue;
+                if (!known || known->isFolder || known->size != info.size || known->mtime != info.mtime) {
+                    changes.push_back({entry.name, fileNode(entry.name, info)});
+                }
+            }
+        }
+        for (const LiveNode* child : folder->children) {
+            if (!present.count(child->name)) changes.push_back({child->name, nullptr});
+        }
+        std::int64_t change = applyChanges(rel, std::move(changes));
+        recordMtime(rel, folderInfo.mtime);
+        return change;
+    }
+
+    /**
+     * Stores a folder's mtime. mtimes have whole seconds, so one taken in
+     * its own second can hide later changes: such folders are listed
+     * again by the next mtime check.
+     */
+    void recordMtime(const std::string& rel, std::int64_t mtime) {
+        if (wal) wal->logTouch(rel, mtime);
+        tree.touch(rel, mtime);
+        if (mtime >= static_cast<std::int64_t>(std::time(nullptr)) - 1) racyFolders.insert(rel);
+        else racyFolders.erase(rel);
+    }
+
+    /**
+     * Re-lists `folder` if it changed on disk, else stats its files (one
+     * written in place leaves the folder's mtime alone); then checks its
+     * subfolders
+     */
+    void revalidateFolder(const LiveNode* folder, const std::string& rel, std::uint64_t& rescanned) {
+        fs::path full = rel.empty() ? rootPath : rootPath / fs::u8path(rel);
+        auto childRel = [&rel](const std::string& name) { return rel.empty() ? name : rel + "/" + name; };
+
+        EntryInfo folderInfo;
+        if (fsBackend->stat(full, folderInfo) != FsResult::Ok) return;
+
+        // See recordMtime() for why recent mtimes aren't trusted
+        std::int64_t now = static_cast<std::int64_t>(std::time(nullptr));
+        std::vector<const LiveNode*> unchangedFolders;
+        if (folderInfo.mtime == folder->mtime && folderInfo.mtime < now - 1 && !racyFolders.count(rel)) {
+            std::vector<std::pair<std::string, const LiveNode*>> changes;
+            for (const LiveNode* child : folder->children) {
+                if (child->isFolder) {
+                    unchangedFolders.push_back(child);
+                    continue;
+                }
+                EntryInfo info;
+                if (fsBackend->stat(full / fs::u8path(child->name), info) != FsResult::Ok) continue;
+                if (info.size != child->size || info.alloc != child->alloc || info.mtime != child->mtime) {
+                    changes.push_back({child->name, fileNode(child->name, info)});
+                }
+            }
+            if (!changes.empty()) {
+                rescanned++;
+                growth[rel] += applyChanges(rel, std::move(changes));
+            }
+        } else {
+            rescanned++;
+            growth[rel] += relistFolder(folder, rel, &unchangedFolders);
+        }
+
+        for (const LiveNode* child : unchangedFolders) {
+            revalidateFolder(child, childRel(child->name), rescanned);
+        }
+    }
+};
+#endif
+
+/**
+ * Largest entries of the root, or with `growth` the fastest growing
+ * folders anywhere below it.
+ */
+void printLiveView(const fs::path& rootPath, const LiveNode* root, std::uint64_t version,
+                   const WriteRates::Board* growth) {
+    clearScreen();
+    std::cout << "\nWatching: " << rootPath.string() << "  (live, version " << version << ")\n";
+    std::cout << "Total:    " << formatSize(root->size) << "\n";
+
+    if (growth) {
+        double totalRate = 0;
+        for (const auto& entry : *growth) {
+            if (entry.folder.empty()) totalRate = entry.rate;
+        }
+        std::cout << "Growing:  " << formatSize(static_cast<std::uintmax_t>(totalRate)) << "/s\n";
+        std::cout << std::string(60, '-') << "\n\n";
+        for (const auto& entry : *growth) {
+            if (entry.folder.empty()) continue;
+            std::string name = entry.folder.size() > 44 ? "..." + entry.folder.substr(entry.folder.size() - 41) : entry.folder;
+            std::cout << "  " << std::left << std::setw(44) << name << " "
+                      << std::right << std::setw(10) << formatSize(static_cast<std::uintmax_t>(entry.rate)) << "/s\n";
+        }
+    } else {
+        std::cout << std::string(60, '-') << "\n\n";
+        std::vector<const LiveNode*> top(root->children.begin(), root->children.end());
+        std::sort(top.begin(), top.end(), [](const LiveNode* a, const LiveNode* b) { return a->size > b->size; });
+        if (top.size() > 20) top.resize(20);
+        for (const LiveNode* node : top) {
+            std::string name = node->name + (node->isFolder ? std::string(1, static_cast<char>(fs::path::preferred_separator)) : "");
+            std::cout << "  " << std::left << std::setw(40) << name.substr(0, 40) << " "
+                      << std::right << std::setw(12) << formatSize(node->size) << "\n";
+        }
+    }
+
+    std::cout << "\n" << std::string(60, '-') << "\n";
+    std::cout << "  'g' = growth rates | 's' = sizes | 'q' = quit  (then Enter)\n";
+    std::cout << std::string(60, '-') << "\n" << std::flush;
+}
+
+/**
+ * --watch: scan once, then keep the tree current from change
+ * notifications and redraw every second (sizes or growth rates).
+ */
+int runWatch(const fs::path& rootPath, const fs::path& stateFile) {
+#ifdef __linux__
+    // With --state: start from the saved snapshot plus its log
+    fs::path walFile = stateFile;
+    walFile += ".wal";
+    ScanTree scanned;
+    bool restored = false;
+    if (!stateFile.empty() && fs::exists(stateFile)) {
+        restored = readSnapshot(stateFile, scanned) && scanned.rootPath == rootPath;
+        if (!restored) {
+            std::cout << "  Saved state is for another folder or unreadable, scanning again\n";
+        }
+    }
+    if (!restored) {
+        std::cout << "\nScanning " << rootPath.string() << "...\n";
+        scanned = buildTree(rootPath);
+    }
+    LiveTree tree(liveFromTree(scanned, 0));
+
+    TreeWatcher watcher(rootPath, tree);
+    if (!watcher.ok()) {
+        std::cerr << "Error: Cannot start inotify: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    if (restored) {
+        std::uint64_t replayed = WriteAheadLog::replay(walFile, tree);
+        std::cout << "  Restored state from " << stateFile.string() << " + " << replayed << " logged changes\n";
+        watcher.watchLive(tree.current(), "");
+    } else {
+        watcher.watchTree(scanned, "");
+    }
+    scanned = ScanTree();
+
+    WriteAheadLog wal;
+    if (!stateFile.empty()) {
+        if (!wal.open(walFile)) {
+            std::cerr << "Error: Cannot open " << walFile << "\n";
+            return 1;
+        }
+        watcher.setState(stateFile, &wal);
+        if (restored) {
+            std::cout << "  Checking for changes made while not watching... " << std::flush;
+            std::cout << watcher.revalidate() << " folders changed\n";
+        }
+        watcher.compact();
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> growthView{false};
+    std::thread updater([&]() { watcher.run(stop); });
+    std::thread display([&]() {
+        EpochDomain::Slot& slot = tree.registerReader();
+        while (!stop) {
+            {
+                LiveTree::Reader reader(tree, slot);
+                auto board = watcher.leaderboard();
+                printLiveView(rootPath, reader.root, tree.version(), growthView ? board.get() : nullptr);
+            }
+            for (int i = 0; i < 10 && !stop; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    });
+
+    std::string input;
+    while (std::getline(std::cin, input) && input != "q" && input != "Q") {
+        if (input == "g" || input == "G") growthView = true;
+        if (input == "s" || input == "S") growthView = false;
+    }
+    stop = true;
+    updater.join();
+    display.join();
+    if (!watcher.compact()) {
+        std::cerr << "Error: Cannot save state to " << stateFile << "\n";
+        return 1;
+    }
+    return 0;
+#else
+    (void)rootPath;
+    (void)stateFile;
+    std::cerr << "Error: --watch needs Linux (inotify)\n";
+    return 1;
+#endif
+}
+
+// ============================================================================
+// DISPLAY
+// ============================================================================
+
+/**
+ * Everything one frame of the explorer shows. Whoever has new data builds
+ * one; it is never changed after it has been published.
+ */
+struct ViewModel {
+    fs::path path;
+    std::vector<FolderEntry> rows;      // largest first, as given to makeViewModel
+    std::uintmax_t total = 0;           // sum of the scanned rows (apparent size)
+    std::uintmax_t quotaTotal = 0;      // sum of the project quota rows (allocated)
+    std::string filterLabel;
+    std::string status;
+};
+
+std::shared_ptr<const ViewModel> makeViewModel(const fs::path& path, std::vector<FolderEntry> rows,
+                                               const std::string& filterLabel, const std::string& status = "") {
+    auto view = std::make_shared<ViewModel>();
+    view->path = path;
+    for (const auto& row : rows) (row.fromQuota ? view->quotaTotal : view->total) += row.size;
+    view->rows = std::move(rows);
+    view->filterLabel = filterLabel;
+    view->status = status;
+    return view;
+}
+
+void displayCurrentLevel(const ViewModel& view) {
+    const std::vector<FolderEntry>& folders = view.rows;
+    clearScreen();
+    
+    std::cout << "============================================================\n";
+    std::cout << "  DiskScope - Interactive Disk Explorer\n";
+    std::cout << "============================================================\n\n";
+    
+    std::cout << "Current: " << view.path.string() << "\n";
+    std::cout << "Total:   " << formatSize(view.total) << " in " << folders.size() << " folders";
+    if (view.quotaTotal > 0) {
+        std::cout << " + " << formatSize(view.quotaTotal) << " allocated (project quotas)";
+    }
+    std::cout << "\n";
+    if (!view.filterLabel.empty()) {
+        std::cout << "Filter:  " << view.filterLabel << " (second column)\n";
+    }
+    if (!view.status.empty()) {
+        std::cout << "Status:  " << view.status << "\n";
+    }
+    std::cout << "------------------------------------------------------------\n\n";
+    
+    if (folders.empty()) {
+        std::cout << "  (No subfolders found)\n";
+    } else {
+        // Find max name length for alignment
+        size_t maxNameLen = 0;
+        for (const auto& f : folders) {
+            maxNameLen = std::max(maxNameLen, f.name.length());
+        }
+        maxNameLen = std::min(maxNameLen, size_t(40)); // Cap at 40 chars
+        
+        for (size_t i = 0; i < folders.size(); ++i) {
+            std::string displayName = folders[i].name;
+            if (displayName.length() > 40) {
+                displayName = displayName.substr(0, 37) + "...";
+            }
+            
+            std::cout << "  [" << std::setw(2) << i << "] "
+                      << std::left << std::setw(maxNameLen + 2) << displayName
+                      << std::right << std::setw(12) << formatSize(folders[i].size);
+            if (!view.filterLabel.empty()) {
+                std::cout << std::setw(12) << formatSize(folders[i].matchedSize);
+            }
+            std::cout << (folders[i].timedOut ? "  (timed out, partial)" : "")
+                      << (folders[i].fromQuota ? "  (allocated, project quota)" : "")
+                      << (folders[i].stale ? "  (cached)" : "")
+                      << "\n";
+        }
+    }
+    
+    std::cout << "\n------------------------------------------------------------\n";
+    std::cout << "  [num] = enter | 'b' = back | 'g' = go to | 'l' = own size | 'r' = refresh | 'f' = filter\n";
+    std::cout << "------------------------------------------------------------\n";
+    std::cout << "> ";
+}
+
+// Shortest time between two frames; updates in between are merged
+const std::chrono::milliseconds FRAME_INTERVAL(30);
+
+/**
+ * Draws the explorer on its own thread. The scanner, the input handler
+ * and background refreshes publish a new view model with an atomic
+ * pointer swap and carry on; the thread draws the newest one and skips
+ * any it was too slow for, so a slow terminal never holds up a scan.
+ */
+class Renderer {
+public:
+    Renderer() : thread([this] { run(); }) {}
+
+    ~Renderer() {
+        stopping = true;
+        wake.notify_one();
+        thread.join();
+    }
+
+    /**
+     * Publishes a new screen from the input handler, ends hold()
+     */
+    void show(std::shared_ptr<const ViewModel> view) {
+        publish(std::move(view), true);
+    }
+
+    /**
+     * Publishes progress from background work, drawn unless on hold
+     */
+    void update(std::shared_ptr<const ViewModel> view) {
+        publish(std::move(view), false);
+    }
+
+    /**
+     * Stops drawing (after any frame in progress) so prompts stay readable
+     */
+    void hold() {
+        held = true;
+        std::lock_guard<std::mutex> wait(drawMutex);
+    }
+
+    /**
+     * The frame on screen; numbers the user types refer to its rows
+     */
+    std::shared_ptr<const ViewModel> drawn() const {
+        return std::atomic_load(&lastDrawn);
+    }
+
+private:
+    std::shared_ptr<const ViewModel> latest;        // atomic_load / atomic_store only
+    std::shared_ptr<const ViewModel> lastDrawn;
+    std::atomic<std::uint64_t> version{0};
+    std::atomic<bool> held{false};
+    std::atomic<bool> stopping{false};
+    std::mutex drawMutex;                           // taken while a frame is drawn
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::thread thread;                             // last, started once the rest exists
+
+    void publish(std::shared_ptr<const ViewModel> view, bool release) {
+        std::atomic_store(&latest, std::move(view));
+        if (release) held = false;
+        version++;
+        wake.notify_one();
+    }
+
+    void run() {
+        std::uint64_t seen = 0;
+        while (!stopping) {
+            {
+                // Publishers never take this lock; a missed wakeup costs one interval
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wake.wait_for(lock, FRAME_INTERVAL, [&] { return stopping || (!held && version != seen); });
+            }
+            {
+                std::lock_guard<std::mutex> draw(drawMutex);
+                if (stopping || held || version == seen) continue;
+                seen = version;
+                auto view = std::atomic_load(&latest);
+                displayCurrentLevel(*view);
+                std::cout << std::flush;
+                std::atomic_store(&lastDrawn, view);
+            }
+            std::this_thread::sleep_for(FRAME_INTERVAL);
+        }
+    }
+};
+
+// ============================================================================
+// CACHED STARTUP (stale-while-revalidate)
+// ============================================================================
+
+// Full scans leave a snapshot in the cache folder; the next interactive
+// start shows it at once and refreshes it in the background
+bool snapshotCacheEnabled = true;
+
+fs::path snapshotCacheDir() {
+#ifdef _WIN32
+    const char* base = std::getenv("LOCALAPPDATA");
+    return base && *base ? fs::path(base) / "diskscope" : fs::path();
+#else
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) return fs::path(xdg) / "diskscope";
+    const char* home = std::getenv("HOME");
+    return home && *home ? fs::path(home) / ".cache" / "diskscope" : fs::path();
+#endif
+}
+
+/**
+ * Cache file for a scan root: FNV-1a of the normalized path, so the
+ * same folder always maps to the same file.
+ */
+fs::path snapshotCacheFile(const fs::path& root) {
+    fs::path dir = snapshotCacheDir();
+    if (dir.empty()) return dir;
+
+    std::string key = root.lexically_normal().u8string();
+    while (key.size() > 1 && (key.back() == '/' || key.back() == '\\')) {
+        key.pop_back();
+    }
+    std::uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : key) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << h << ".snap";
+    return dir / name.str();
+}
+
+/**
+ * Stores a full scan as the cached snapshot of its root. Written to a
+ * temporary file first so a reader never sees half a snapshot.
+ */
+void saveCachedSnapshot(const ScanTree& tree) {
+    if (!snapshotCacheEnabled) return;
+    fs::path file = snapshotCacheFile(tree.rootPath);
+    if (file.empty()) return;
+
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    fs::path temp = file;
+    temp += ".tmp";
+    if (writeSnapshot(tree, temp, false)) {
+        fs::rename(temp, file, ec);
+    }
+}
+
+/**
+ * Cached snapshot that contains `path`: its own, or the closest one of
+ * an enclosing folder. nullptr if there is none.
+ */
+std::unique_ptr<ScanTree> loadCachedSnapshot(const fs::path& path) {
+    std::error_code ec;
+    for (fs::path folder = path;; folder = folder.parent_path()) {
+        fs::path file = snapshotCacheFile(folder);
+        if (!file.empty() && fs::exists(file, ec)) {
+            auto tree = std::make_unique<ScanTree>();
+            if (readSnapshot(file, *tree) && findNode(*tree, path) != NO_NODE) {
+                return tree;
+            }
+        }
+        if (folder == folder.parent_path()) break;
+    }
+    return nullptr;
+}
+
+std::string formatAge(std::int64_t seconds) {
+    std::ostringstream out;
+    if (seconds < 60) out << "just now";
+    else if (seconds < 3600) out << seconds / 60 << " min ago";
+    else if (seconds < 86400) out << seconds / 3600 << " h ago";
+    else out << seconds / 86400 << " d ago";
+    return out.str();
+}
+
+/**
+ * Sets a folder's total in the tree, carrying the difference up to the root
+ */
+void patchFolderSize(ScanTree& tree, const fs::path& path, std::uintmax_t bytes, bool timedOut) {
+    std::uint32_t node = findNode(tree, path);
+    if (node == NO_NODE) return;
+    std::uintmax_t old = tree.size[node];
+    for (std::uint32_t up = node; up != NO_NODE; up = tree.parent[up]) {
+        tree.size[up] = tree.size[up] - old + bytes;
+        if (timedOut) tree.timedOut[up] = 1;
+    }
+    if (!timedOut) tree.timedOut[node] = 0;
+}
+
+/**
+ * Brings a cached tree up to date while it is being browsed. The
+ * folders on screen are resized first, most urgent at the front of the
+ * queue; once they are done the whole root is rescanned, saved back to
+ * the cache and handed over. New frames go to the renderer as sizes
+ * come in. After that, refresh() still resizes a level; main() patches
+ * the results into the tree it took (takeSizes()).
+ */
+class Revalidator {
+public:
+    Revalidator(const fs::path& root, std::int64_t cachedAt, Renderer& renderer)
+        : root(root), cachedAt(cachedAt), renderer(renderer) {
+        unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+        scanner = std::thread([this] { rescan(); });
+        publisher = std::thread([this] { publishUpdates(); });
+    }
+
+    ~Revalidator() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        scanCancelled = true;
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+        scanner.join();
+        publisher.join();
+        scanCancelled = false;
+    }
+
+    /**
+     * Shows a level and puts its unchecked folders at the front of the queue
+     */
+    void show(const fs::path& path, const std::vector<FolderEntry>& folders, const std::string& filterLabel) {
+        std::lock_guard<std::mutex> lock(mutex);
+        screenPath = path;
+        screen = folders;
+        screenFilter = filterLabel;
+        if (!done) {
+            // Reversed so the largest ends up first
+            for (auto it = folders.rbegin(); it != folders.rend(); ++it) {
+                if (it->node != NO_NODE && !fresh.count(it->path.u8string())) queue.push_front(it->path);
+            }
+        }
+        started = true;
+        renderer.show(view());
+        wake.notify_all();
+    }
+
+    /**
+     * Forgets the fresh sizes of these folders so show() checks them
+     * again; after the rescan they are queued here instead
+     */
+    void refresh(const std::vector<FolderEntry>& folders) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& folder : folders) {
+            std::string key = folder.path.u8string();
+            fresh.erase(key);
+            if (done && folder.node != NO_NODE && refreshing.insert(key).second) queue.push_back(folder.path);
+        }
+        wake.notify_all();
+    }
+
+    struct Size {
+        std::uintmax_t bytes;
+        bool timedOut;
+    };
+
+    /**
+     * Sizes rechecked since the rescan was done, keyed by u8 path; each
+     * is handed out once, for patchFolderSize()
+     */
+    std::map<std::string, Size> takeSizes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, Size> sizes;
+        if (done) sizes.swap(fresh);
+        return sizes;
+    }
+
+    /**
+     * The rescanned tree once it is ready (only once), else nullptr
+     */
+    std::unique_ptr<ScanTree> takeTree() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::move(rescanned);
+    }
+
+private:
+    fs::path root;
+    std::int64_t cachedAt;
+    Renderer& renderer;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<fs::path> queue;                 // may hold repeats, skipped when popped
+    std::unordered_set<std::string> running;
+    std::map<std::string, Size> fresh;
+    std::unordered_set<std::string> refreshing; // queued by refresh() after the rescan
+    std::unique_ptr<ScanTree> rescanned;        // until main() takes it
+    bool done = false;                          // full rescan finished
+    bool started = false;                       // first level shown
+    bool stopping = false;
+    bool dirty = false;
 
-    for (const auto& entry : dirIter) {
-        std::error_code entryEc;
-        
-        // Only process directories
-        if (entry.is_directory(entryEc) && !entryEc && !entry.is_symlink(entryEc)) {
-            // Launch async task for each folder
-            tasks.push_back({
-                std::async(std::launch::async, calculateFolderSize, entry.path()),
-                entry.path().filename().string(),
-                entry.path()
-            });
+    fs::path screenPath;
+    std::vector<FolderEntry> screen;
+    std::string screenFilter;
+
+    std::vector<std::thread> workers;
+    std::thread scanner;
+    std::thread publisher;
+
+    bool onScreen(const std::string& key) const {
+        for (const auto& folder : screen) {
+            if (folder.path.u8string() == key) return true;
         }
+        return false;
     }
-    
-    // Collect results
-    for (auto& task : tasks) {
-        FolderEntry folder;
-        folder.name = task.name;
-        folder.path = task.path;
-        folder.accessDenied = false;
-        
-        // .get() waits for the thread to finish
-        folder.size = task.future.get();
-        
-        folders.push_back(folder);
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+
+            fs::path path = queue.front();
+            queue.pop_front();
+            std::string key = path.u8string();
+            if (fresh.count(key) || !running.insert(key).second) {
+                wake.notify_all();      // the queue may have just run dry
+                continue;
+            }
+
+            lock.unlock();
+            bool timedOut = false;
+            auto visited = followSymlinks ? std::make_unique<VisitedSet>() : nullptr;
+            std::uintmax_t bytes = calculateFolderSize(path, timedOut, visited.get());
+            lock.lock();
+
+            running.erase(key);
+            refreshing.erase(key);
+            if (!scanCancelled) {
+                fresh[key] = {bytes, timedOut};
+                dirty = dirty || onScreen(key);
+            }
+            wake.notify_all();
+        }
     }
-    
-    // Sort by size descending (largest first)
-    std::sort(folders.begin(), folders.end(),
-        [](const FolderEntry& a, const FolderEntry& b) {
-            return a.size > b.size;
-        });
-    
-    return folders;
-}
 
-// ============================================================================
-// DISPLAY
-// ============================================================================
+    void rescan() {
+        {
+            // The folders on screen go first, the whole tree after them
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || (started && queue.empty() && running.empty()); });
+            if (stopping) return;
+        }
 
-void displayCurrentLevel(const fs::path& currentPath, const std::vector<FolderEntry>& folders) {
-    clearScreen();
-    
-    std::cout << "============================================================\n";
-    std::cout << "  DiskScope - Interactive Disk Explorer\n";
-    std::cout << "============================================================\n\n";
-    
-    std::cout << "Current: " << currentPath.string() << "\n";
-    std::cout << "------------------------------------------------------------\n\n";
-    
-    if (folders.empty()) {
-        std::cout << "  (No subfolders found)\n";
-    } else {
-        // Find max name length for alignment
-        size_t maxNameLen = 0;
-        for (const auto& f : folders) {
-            maxNameLen = std::max(maxNameLen, f.name.length());
+        auto tree = std::make_unique<ScanTree>(buildTree(root, false));
+        if (scanCancelled) return;
+        saveCachedSnapshot(*tree);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        rescanned = std::move(tree);
+        done = true;
+        queue.clear();      // the new tree has them all
+        fresh.clear();
+        dirty = true;
+        wake.notify_all();
+    }
+
+    void publishUpdates() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || dirty; });
+            // A burst of results becomes one frame
+            wake.wait_for(lock, std::chrono::milliseconds(100), [this] { return stopping; });
+            if (stopping) return;
+            dirty = false;
+            // Under the mutex, so it can't overtake a newer show()
+            renderer.update(view());
         }
-        maxNameLen = std::min(maxNameLen, size_t(40)); // Cap at 40 chars
-        
-        for (size_t i = 0; i < folders.size(); ++i) {
-            std::string displayName = folders[i].name;
-            if (displayName.length() > 40) {
-                displayName = displayName.substr(0, 37) + "...";
+    }
+
+    /**
+     * The current level with the newest sizes known (mutex held)
+     */
+    std::shared_ptr<const ViewModel> view() const {
+        std::vector<FolderEntry> rows = screen;
+        std::size_t checked = 0, pending = 0;
+        for (auto& folder : rows) {
+            if (folder.node == NO_NODE) continue;       // scanned from disk, outside the tree
+            std::string key = folder.path.u8string();
+            auto it = fresh.find(key);
+            if (it != fresh.end()) {
+                folder.size = it->second.bytes;
+                folder.timedOut = it->second.timedOut;
+                checked++;
+            } else if (rescanned) {
+                std::uint32_t node = findNode(*rescanned, folder.path);
+                if (node != NO_NODE) {
+                    folder.size = rescanned->size[node];
+                    folder.timedOut = rescanned->timedOut[node] != 0;
+                }
+            } else if (!done || refreshing.count(key)) {
+                folder.stale = true;
+                pending++;
             }
-            
-            std::cout << "  [" << std::setw(2) << i << "] "
-                      << std::left << std::setw(maxNameLen + 2) << displayName
-                      << std::right << std::setw(12) << formatSize(folders[i].size)
-                      << "\n";
         }
+        std::ostringstream status;
+        if (done && pending > 0) {
+            status << "refreshing (" << checked << " of " << checked + pending << " rechecked)";
+        } else if (done) {
+            status << "up to date";
+        } else {
+            std::int64_t age = static_cast<std::int64_t>(std::time(nullptr)) - cachedAt;
+            status << "cached " << formatAge(age) << ", refreshing (" << checked << " of "
+                   << checked + pending << " rechecked)";
+        }
+        sortBySize(rows);
+        return makeViewModel(screenPath, std::move(rows), screenFilter, status.str());
     }
-    
-    std::cout << "\n------------------------------------------------------------\n";
-    std::cout << "  [num] = enter | 'b' = back | 'r' = refresh\n";
-    std::cout << "------------------------------------------------------------\n";
-    std::cout << "> ";
-}
+};
 
 // ============================================================================
 // DRIVE DETECTION (Windows)
@@ -268,6 +6543,249 @@ fs::path selectDrive() {
     return drives.empty() ? fs::path("C:\\") : drives[0];
 }
 
+// ============================================================================
+// GO TO (type-ahead path prompt)
+// ============================================================================
+
+/**
+ * Subfolder names for completion, sorted so all names with a given
+ * prefix are one lower_bound away. They come from the snapshot, else
+ * from folders already scanned, else from a plain listing; nothing is
+ * sized until the jump lands.
+ */
+class PathCompleter {
+public:
+    /**
+     * Completes from `tree` where it has the folder; outside it from the
+     * scanned levels or the disk, unless `treeOnly` (a saved snapshot)
+     */
+    PathCompleter(const ScanTree* tree, bool treeOnly, const std::map<std::string, std::vector<FolderEntry>>& scanned)
+        : tree(tree), treeOnly(treeOnly), scanned(scanned) {}
+
+    const std::vector<std::string>& childNames(const fs::path& folder) {
+        std::string key = folder.string();
+        auto known = names.find(key);
+        if (known != names.end()) return known->second;
+
+        std::vector<std::string> list;
+        auto cached = scanned.find(key);
+        std::uint32_t node = tree ? findNode(*tree, folder) : NO_NODE;
+        if (node != NO_NODE) {
+            for (std::uint32_t c = node + 1; c < tree->subtreeEnd[node]; c = tree->subtreeEnd[c]) {
+                if (tree->isFolder[c]) list.emplace_back(tree->name(c));
+            }
+        } else if (tree && treeOnly) {
+            // Above the snapshot root: only the way down to it
+            fs::path below = tree->rootPath.lexically_relative(folder);
+            if (!below.empty() && *below.begin() != ".." && *below.begin() != ".") {
+                list.push_back(below.begin()->u8string());
+            }
+        } else if (cached != scanned.end()) {
+            for (const FolderEntry& entry : cached->second) list.push_back(entry.name);
+        } else {
+            std::vector<DirEntry> entries;
+            fsBackend->list(folder, entries);
+            for (const DirEntry& entry : entries) {
+                if (entry.type == EntryType::Folder) list.push_back(entry.name);
+            }
+        }
+        std::sort(list.begin(), list.end());
+        return names.emplace(key, std::move(list)).first->second;
+    }
+
+    /** Names in `folder` starting with `prefix`, in order */
+    std::vector<std::string> complete(const fs::path& folder, const std::string& prefix) {
+        const std::vector<std::string>& list = childNames(folder);
+        std::vector<std::string> matches;
+        for (auto it = std::lower_bound(list.begin(), list.end(), prefix);
+             it != list.end() && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+            matches.push_back(*it);
+        }
+        return matches;
+    }
+
+    /**
+     * Follows `typed` from `from`. Every component before the last must
+     * name a folder exactly or be the prefix of exactly one; the last one
+     * (still being typed) is left in `last`. Returns false with `error`
+     * set if a component leads nowhere.
+     */
+    bool walk(const fs::path& from, std::string typed, fs::path& folder, std::string& last, std::string& error) {
+        folder = from;
+        fs::path root = fs::u8path(typed).root_path();
+        if (!root.empty()) {
+            folder = root;
+            typed.erase(0, root.u8string().size());
+        }
+
+        std::size_t start = 0;
+        for (std::size_t end; (end = typed.find_first_of(SEPARATORS, start)) != std::string::npos; start = end + 1) {
+            if (!step(folder, typed.substr(start, end - start), error)) return false;
+        }
+        last = typed.substr(start);
+        return true;
+    }
+
+    /** The folder `typed` names, completing unique prefixes */
+    bool resolve(const fs::path& from, const std::string& typed, fs::path& target, std::string& error) {
+        std::string last;
+        if (!walk(from, typed, target, last, error) || !step(target, last, error)) return false;
+        if (tree && treeOnly && findNode(*tree, target) == NO_NODE) {
+            error = target.string() + " is outside the snapshot (" + tree->rootPath.string() + ")";
+            return false;
+        }
+        return true;
+    }
+
+private:
+#ifdef _WIN32
+    static constexpr const char* SEPARATORS = "/\\";
+#else
+    static constexpr const char* SEPARATORS = "/";
+#endif
+
+    bool step(fs::path& folder, const std::string& name, std::string& error) {
+        if (name.empty() || name == ".") return true;
+        if (name == "..") {
+            folder = folder.parent_path();
+            return true;
+        }
+        const std::vector<std::string>& list = childNames(folder);
+        if (std::binary_search(list.begin(), list.end(), name)) {
+            folder /= fs::u8path(name);
+            return true;
+        }
+        std::vector<std::string> matches = complete(folder, name);
+        if (matches.size() != 1) {
+            error = matches.empty() ? "no folder '" + name + "' in " + folder.string()
+                                    : "'" + name + "' could be " + std::to_string(matches.size()) + " folders";
+            return false;
+        }
+        folder /= fs::u8path(matches[0]);
+        return true;
+    }
+
+    const ScanTree* tree;
+    bool treeOnly;
+    const std::map<std::string, std::vector<FolderEntry>>& scanned;
+    std::map<std::string, std::vector<std::string>> names;
+};
+
+/**
+ * One key at a time, without echo, while it exists. Inactive (and the
+ * caller falls back to line input) when stdin isn't a terminal.
+ */
+class RawInput {
+public:
+    RawInput() {
+#ifdef _WIN32
+        active = _isatty(_fileno(stdin)) != 0;
+#else
+        if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved) != 0) return;
+        termios raw = saved;
+        raw.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        active = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+#endif
+    }
+
+    ~RawInput() {
+#ifndef _WIN32
+        if (active) tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+#endif
+    }
+
+    bool isActive() const { return active; }
+
+    // Next key, or -1 at end of input
+    int key() {
+#ifdef _WIN32
+        return _getch();
+#else
+        unsigned char c;
+        return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+#endif
+    }
+
+private:
+    bool active = false;
+#ifndef _WIN32
+    termios saved;
+#endif
+};
+
+const std::size_t GOTO_SHOWN_MATCHES = 6;
+
+/**
+ * "Go to" prompt: completes the path from the names in memory as it is
+ * typed. Tab extends the last component as far as it is unambiguous,
+ * Enter jumps (unique prefixes are enough at every level), Esc cancels.
+ * `typed` non-empty ("g usr/lo" on the command line) jumps at once.
+ */
+bool promptGoTo(PathCompleter& completer, const fs::path& from, std::string typed, fs::path& target) {
+    std::string error;
+    if (!typed.empty()) {
+        if (completer.resolve(from, typed, target, error)) return true;
+        std::cout << "Cannot go to " << typed << ": " << error << ". Press Enter to continue...";
+        std::cin.get();
+        return false;
+    }
+
+    RawInput input;
+    if (!input.isActive()) {
+        std::cout << "Go to: ";
+        std::getline(std::cin, typed);
+        return !typed.empty() && promptGoTo(completer, from, typed, target);
+    }
+
+    while (true) {
+        fs::path folder;
+        std::string last;
+        std::vector<std::string> matches;
+        bool valid = completer.walk(from, typed, folder, last, error);
+        if (valid) matches = completer.complete(folder, last);
+
+        std::cout << "\r\033[KGo to: " << typed << "   ";
+        if (!valid) {
+            std::cout << "(" << error << ")";
+        } else if (matches.empty()) {
+            std::cout << "(no match)";
+        } else if (matches.size() > 1 || matches[0] != last) {
+            for (std::size_t m = 0; m < matches.size() && m < GOTO_SHOWN_MATCHES; ++m) {
+                std::cout << (m ? "  " : "[") << matches[m];
+            }
+            if (matches.size() > GOTO_SHOWN_MATCHES) std::cout << "  +" << matches.size() - GOTO_SHOWN_MATCHES;
+            std::cout << "]";
+        }
+        std::cout << std::flush;
+
+        int key = input.key();
+        if (key == -1 || key == 27) {           // end of input, Esc
+            std::cout << "\n";
+            return false;
+        } else if (key == '\r' || key == '\n') {
+            if (completer.resolve(from, typed, target, error)) {
+                std::cout << "\n";
+                return true;
+            }
+        } else if (key == '\t' && valid && !matches.empty()) {
+            std::string common = matches[0];
+            for (const std::string& match : matches) {
+                std::size_t same = 0;
+                while (same < common.size() && same < match.size() && common[same] == match[same]) same++;
+                common.resize(same);
+            }
+            typed += common.substr(last.size());
+            if (matches.size() == 1) typed += '/';
+        } else if (key == 127 || key == 8) {    // Backspace
+            if (!typed.empty()) typed.pop_back();
+        } else if (key >= 32) {
+            typed += static_cast<char>(key);
+        }
+    }
+}
+
 // ============================================================================
 // MAIN - INTERACTIVE LOOP
 // ============================================================================
@@ -285,44 +6803,343 @@ void setupConsole() {
 int main(int argc, char* argv[]) {
     setupConsole();
     
-    // Determine starting path
+    // Determine starting path and mode
     fs::path currentPath;
+    fs::path htmlReportDir;
+    fs::path arrowFile;
+    fs::path traceFile;
+    fs::path recordFile;
+    fs::path replayFile;
+    bool replayLatency = false;
+    bool slowReport = false;
+    long timeoutMs = 0;
+    fs::path saveSnapshotFile;
+    fs::path snapshotFile;
+    std::string hangPattern;
+    bool watchMode = false;
+    bool heaviestPath = false;
+    bool duplicates = false;
+    bool packages = false;
+    bool compressibility = false;
+    bool ownSize = false;
+    fs::path foldedFile;
+    fs::path stateFile;
     
-    if (argc > 1) {
-        std::string arg = argv[1];
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
         if (arg == "-h" || arg == "--help" || arg == "/?") {
             std::cout << "\nDiskScope - Interactive Disk Explorer\n";
             std::cout << "=====================================\n\n";
-            std::cout << "Usage: diskscope [path]\n\n";
+            std::cout << "Usage: diskscope [options] [path]\n\n";
+            std::cout << "Options:\n";
+            std::cout << "  --html-report DIR   Scan the whole tree (or a --snapshot) and write a browsable report to DIR\n";
+            std::cout << "  --arrow FILE        Scan the whole tree (or a --snapshot) and export one row per entry as Arrow IPC\n";
+            std::cout << "  --folded FILE       Scan the whole tree (or a --snapshot) and export folded stacks for flame graphs\n";
+            std::cout << "  --folded-min SIZE   With --folded: fold folders smaller than SIZE into their parent (default 1M)\n";
+            std::cout << "  --trace FILE        Record scan worker activity as Chrome trace JSON (Perfetto)\n";
+            std::cout << "  --record F          Scan the whole tree and record every filesystem call to F\n";
+            std::cout << "  --replay F          Scan from a --record file instead of the disk (benchmarks)\n";
+            std::cout << "  --replay-latency    With --replay: wait as long as each recorded call took\n";
+            std::cout << "  --slow-report       Scan the whole tree and report the slowest folders and devices\n";
+            std::cout << "  --duplicates        Scan the whole tree (or a --snapshot) and report copied folders\n";
+            std::cout << "  --packages          Scan the whole tree (or a --snapshot) and report bytes per installed package\n";
+            std::cout << "  --package-db F      With --packages: read dpkg *.list files from dir F, or package<TAB>path lines\n";
+            std::cout << "  --compressibility   Scan the whole tree, then sample file contents for compression/sparse savings\n";
+            std::cout << "  --sample-budget S   With --compressibility: read at most S bytes (default 64M)\n";
+            std::cout << "  --own-size          Scan the whole tree (or a --snapshot) and list folders with the largest own files\n";
+            std::cout << "  --heaviest-path     Follow the biggest subfolder down to the culprit, opening as few as possible\n";
+            std::cout << "  --save-snapshot F   Scan the whole tree (or re-save a --snapshot) to file F\n";
+            std::cout << "  --snapshot F        Browse a saved snapshot instead of the disk\n";
+            std::cout << "  --archives          With a full scan, list .zip/.tar/.tar.gz contents as folders\n";
+            std::cout << "  --watch             Scan once, then follow changes live (Linux)\n";
+            std::cout << "  --state F           With --watch: keep the tree in F (+ F.wal) across restarts\n";
+            std::cout << "  --follow            Follow symlinks; each real folder is counted once\n";
+            std::cout << "  --no-cache          Don't start from (or save) the cached last full scan\n";
+            std::cout << "  --timeout MS        Give up on any filesystem call that takes longer (hung mounts)\n";
+            std::cout << "  --inject-hang TEXT  Testing: make calls on paths containing TEXT hang\n\n";
             std::cout << "Controls:\n";
             std::cout << "  [number]  Navigate into folder\n";
             std::cout << "  b         Go back to parent\n";
+            std::cout << "  g [PATH]  Go to a path, completing folder names as you type (Tab)\n";
+            std::cout << "  l         Folders below with the largest own files (not counting subfolders)\n";
             std::cout << "  r         Refresh current folder\n";
+            std::cout << "  f         Filter (snapshots): older DAYS, newer DAYS, uid N, larger SIZE, ext .EXT\n";
             std::cout << "  q         Quit\n";
             return 0;
         }
-        currentPath = fs::absolute(arg);
-        
-        // Validate provided path
-        if (!fs::exists(currentPath) || !fs::is_directory(currentPath)) {
-            std::cerr << "Error: Invalid directory: " << currentPath << "\n";
+        else if (arg == "--html-report") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a directory\n";
+                return 1;
+            }
+            htmlReportDir = argv[++i];
+        }
+        else if (arg == "--arrow") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a file name\n";
+                return 1;
+            }
+            arrowFile = argv[++i];
+        }
+        else if (arg == "--trace") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a file name\n";
+                return 1;
+            }
+            traceFile = argv[++i];
+            traceEnabled = true;
+        }
+        else if (arg == "--record" || arg == "--replay") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a file name\n";
+                return 1;
+            }
+            (arg == "--record" ? recordFile : replayFile) = argv[++i];
+        }
+        else if (arg == "--replay-latency") {
+            replayLatency = true;
+        }
+        else if (arg == "--save-snapshot" || arg == "--snapshot") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a file name\n";
+                return 1;
+            }
+            (arg == "--snapshot" ? snapshotFile : saveSnapshotFile) = argv[++i];
+        }
+        else if (arg == "--timeout") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs milliseconds\n";
+                return 1;
+            }
+            try {
+                timeoutMs = std::stol(argv[++i]);
+            } catch (...) {
+                timeoutMs = 0;
+            }
+            if (timeoutMs <= 0) {
+                std::cerr << "Error: Invalid timeout: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--package-db") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a directory or file\n";
+                return 1;
+            }
+            packageDatabase = argv[++i];
+            packages = true;
+        }
+        else if (arg == "--folded") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a file name\n";
+                return 1;
+            }
+            foldedFile = argv[++i];
+        }
+        else if (arg == "--folded-min") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a size\n";
+                return 1;
+            }
+            if (!parseSize(argv[++i], foldedMinSize)) {
+                std::cerr << "Error: Invalid size: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--sample-budget") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a size\n";
+                return 1;
+            }
+            if (!parseSize(argv[++i], sampleBudget) || sampleBudget < SAMPLE_BLOCK) {
+                std::cerr << "Error: Invalid sample budget: " << argv[i] << "\n";
+                return 1;
+            }
+            compressibility = true;
+        }
+        else if (arg == "--inject-hang") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a path fragment\n";
+                return 1;
+            }
+            hangPattern = argv[++i];
+        }
+        else if (arg == "--state") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: " << arg << " needs a file name\n";
+                return 1;
+            }
+            stateFile = fs::absolute(argv[++i]);
+        }
+        else if (arg == "--follow") {
+            followSymlinks = true;
+        }
+        else if (arg == "--no-cache") {
+            snapshotCacheEnabled = false;
+        }
+        else if (arg == "--watch") {
+            watchMode = true;
+        }
+        else if (arg == "--heaviest-path") {
+            heaviestPath = true;
+        }
+        else if (arg == "--duplicates") {
+            duplicates = true;
+        }
+        else if (arg == "--packages") {
+            packages = true;
+        }
+        else if (arg == "--compressibility") {
+            compressibility = true;
+        }
+        else if (arg == "--own-size") {
+            ownSize = true;
+        }
+        else if (arg == "--archives") {
+            archivesEnabled = true;
+        }
+        else if (arg == "--slow-report") {
+            slowReport = true;
+            latencyEnabled = true;
+        }
+        else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            std::cerr << "Error: Unknown option: " << arg << "\n";
             return 1;
         }
-    } else {
+        else {
+            currentPath = fs::absolute(arg);
+        }
+    }
+    
+    // Filesystem calls: real or replayed, optionally recorded, hanging on purpose, under a deadline
+    std::unique_ptr<ReplayBackend> replayBackend;
+    std::unique_ptr<RecordingBackend> recordingBackend;
+    if (!replayFile.empty()) {
+        replayBackend = std::make_unique<ReplayBackend>();
+        replayBackend->withLatency = replayLatency;
+        if (!replayBackend->load(replayFile)) {
+            return 1;
+        }
+        fsBackend = replayBackend.get();
+        snapshotCacheEnabled = false;   // the cache is for the real disk
+        if (currentPath.empty()) currentPath = replayBackend->root;
+    }
+    if (!recordFile.empty()) {
+        recordingBackend = std::make_unique<RecordingBackend>(*fsBackend);
+        fsBackend = recordingBackend.get();
+    }
+    std::unique_ptr<FsBackend> hangingBackend;
+    std::unique_ptr<FsBackend> watchdogBackend;
+    if (!hangPattern.empty()) {
+        hangingBackend = std::make_unique<HangingBackend>(*fsBackend, hangPattern);
+        fsBackend = hangingBackend.get();
+    }
+    if (timeoutMs > 0) {
+        watchdogBackend = std::make_unique<WatchdogBackend>(*fsBackend, std::chrono::milliseconds(timeoutMs));
+        fsBackend = watchdogBackend.get();
+    }
+    
+    // Snapshot mode: browse a saved tree, nothing is read from disk
+    std::unique_ptr<ScanTree> snapshot;
+    if (!snapshotFile.empty()) {
+        // These read the disk or time the scan; a saved tree has neither
+        const char* needsScan = slowReport ? "--slow-report" : compressibility ? "--compressibility"
+                              : !recordFile.empty() ? "--record" : !replayFile.empty() ? "--replay"
+                              : watchMode ? "--watch" : heaviestPath ? "--heaviest-path" : nullptr;
+        if (needsScan) {
+            std::cerr << "Error: " << needsScan << " needs a scan, not a --snapshot\n";
+            return 1;
+        }
+        snapshot = std::make_unique<ScanTree>();
+        if (!readSnapshot(snapshotFile, *snapshot)) {
+            return 1;
+        }
+        if (currentPath.empty() || findNode(*snapshot, currentPath) == NO_NODE) {
+            currentPath = snapshot->rootPath;
+        }
+    }
+    
+    if (currentPath.empty()) {
         // No argument - show drive selection
         currentPath = selectDrive();
-        
-        if (!fs::exists(currentPath) || !fs::is_directory(currentPath)) {
-            std::cerr << "Error: Invalid directory: " << currentPath << "\n";
-            return 1;
+    }
+    
+    // Validate path
+    if (!snapshot && !replayBackend && (!fs::exists(currentPath) || !fs::is_directory(currentPath))) {
+        std::cerr << "Error: Invalid directory: " << currentPath << "\n";
+        return 1;
+    }
+    
+    if (watchMode && !snapshot) {
+        return runWatch(currentPath, stateFile);
+    }
+    
+    if (heaviestPath && !snapshot) {
+        return HeaviestPath(currentPath).run() ? 0 : 1;
+    }
+    
+    // Report mode: scan everything, write files, exit
+    if (!snapshot && (!htmlReportDir.empty() || !arrowFile.empty() || slowReport || duplicates || packages ||
+                      compressibility || ownSize || !foldedFile.empty() || !saveSnapshotFile.empty() || !recordFile.empty() || replayBackend)) {
+        std::cout << "\nScanning " << currentPath.string() << "...\n";
+        auto scanStart = std::chrono::steady_clock::now();
+        ScanTree tree = buildTree(currentPath);
+        if (replayBackend) {
+            std::cout << "  Replayed scan took " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - scanStart).count() << " ms\n";
+        }
+        bool ok = true;
+        if (recordingBackend) ok = recordingBackend->write(recordFile, currentPath) && ok;
+        if (!htmlReportDir.empty()) ok = writeHtmlReport(tree, htmlReportDir) && ok;
+        if (!arrowFile.empty()) ok = writeArrowFile(tree, arrowFile) && ok;
+        if (!foldedFile.empty()) ok = writeFoldedStacks(tree, foldedFile) && ok;
+        if (!saveSnapshotFile.empty()) ok = writeSnapshot(tree, saveSnapshotFile) && ok;
+        if (slowReport) printSlowReport(tree);
+        if (duplicates) printDuplicateReport(tree);
+        if (packages) ok = printPackageReport(tree) && ok;
+        if (compressibility) printCompressibilityReport(tree);
+        if (ownSize) printOwnLeaders(tree.ownLeaders, currentPath, false);
+        saveCachedSnapshot(tree);
+        if (!traceFile.empty()) ok = writeTraceFile(traceFile) && ok;
+        return ok ? 0 : 1;
+    }
+    
+    if (snapshot && (duplicates || packages || ownSize || !foldedFile.empty() || !htmlReportDir.empty() ||
+                     !arrowFile.empty() || !saveSnapshotFile.empty())) {
+        bool ok = true;
+        if (!htmlReportDir.empty()) ok = writeHtmlReport(*snapshot, htmlReportDir) && ok;
+        if (!arrowFile.empty()) ok = writeArrowFile(*snapshot, arrowFile) && ok;
+        if (!foldedFile.empty()) ok = writeFoldedStacks(*snapshot, foldedFile) && ok;
+        if (!saveSnapshotFile.empty()) ok = writeSnapshot(*snapshot, saveSnapshotFile) && ok;
+        if (duplicates) printDuplicateReport(*snapshot);
+        if (ownSize) printOwnLeaders(treeOwnLeaders(*snapshot, 0), snapshot->rootPath, false);
+        if (packages) ok = printPackageReport(*snapshot) && ok;
+        return ok ? 0 : 1;
+    }
+    
+    // Screen output from here on is drawn by its own thread
+    Renderer renderer;
+    
+    // Cached startup: browse the last full scan at once, refresh it behind the screen
+    std::unique_ptr<Revalidator> revalidator;
+    if (!snapshot && snapshotCacheEnabled) {
+        snapshot = loadCachedSnapshot(currentPath);
+        if (snapshot) {
+            revalidator = std::make_unique<Revalidator>(snapshot->rootPath, snapshot->scannedAt, renderer);
         }
     }
     
     // Global cache for folder contents
     std::map<std::string, std::vector<FolderEntry>> globalCache;
+    // Folders with the largest own files below each scanned folder
+    std::map<std::string, OwnLeaders> ownLeadersCache;
 
     std::vector<fs::path> history;
     
+    // Active filter and its per-node sums (snapshots only)
+    FileFilter filter;
+    SubtreeSums filterSums;
+    
     // Main interaction loop
     while (true) {
         
@@ -331,25 +7148,88 @@ int main(int argc, char* argv[]) {
         std::vector<FolderEntry> folders;
         std::string pathKey = currentPath.string();
 
-        if (globalCache.count(pathKey)) {
+        if (revalidator) {
+            if (auto rescanned = revalidator->takeTree()) {
+                snapshot = std::move(rescanned);
+                if (filter.kind != FileFilter::None) {
+                    filterSums = filteredSums(*snapshot, filter);
+                }
+            }
+            // Folders resized by 'r' since then
+            for (const auto& resized : revalidator->takeSizes()) {
+                patchFolderSize(*snapshot, fs::u8path(resized.first), resized.second.bytes,
+                                resized.second.timedOut);
+            }
+        }
+
+        if (snapshot && findNode(*snapshot, currentPath) != NO_NODE) {
+            // Everything is in memory already (outside a cached tree, scanned as usual)
+            folders = treeSubfolders(*snapshot, currentPath);
+            needsScan = false;
+        }
+        else if (globalCache.count(pathKey)) {
              // Found in cache! Use it.
              folders = globalCache[pathKey];
              needsScan = false;
         }
 
         if (needsScan) {
-            std::cout << "\nScanning folders...\n";
-            folders = getSubfolders(currentPath);
+            // Rows show up as their folders finish; frames at most every FRAME_INTERVAL
+            renderer.show(makeViewModel(currentPath, {}, filter.label, "scanning..."));
+            std::mutex partialMutex;
+            std::vector<FolderEntry> partial;
+            auto lastFrame = std::chrono::steady_clock::now();
+            std::uint64_t framesTaken = 0, framesShown = 0;
+            OwnLeaders leaders;
+            folders = getSubfolders(currentPath, [&](const FolderEntry& folder, std::size_t total) {
+                std::vector<FolderEntry> rows;
+                std::uint64_t frame;
+                {
+                    std::lock_guard<std::mutex> lock(partialMutex);
+                    partial.push_back(folder);
+                    auto now = std::chrono::steady_clock::now();
+                    if (now - lastFrame < FRAME_INTERVAL) return;
+                    lastFrame = now;
+                    rows = partial;
+                    frame = ++framesTaken;
+                }
+                // Sorted off the lock; the other workers keep adding rows
+                sortBySize(rows);
+                std::string status = "scanning (" + std::to_string(rows.size()) + " of " +
+                                     std::to_string(total) + " folders sized)";
+                auto view = makeViewModel(currentPath, std::move(rows), filter.label, status);
+                std::lock_guard<std::mutex> lock(partialMutex);
+                if (frame < framesShown) return;   // a newer frame got there first
+                framesShown = frame;
+                renderer.update(std::move(view));
+            }, &leaders);
             // Save to cache
             globalCache[pathKey] = folders;
+            ownLeadersCache[pathKey] = leaders;
+        }
+
+        if (filter.kind != FileFilter::None) {
+            for (auto& folder : folders) {
+                if (folder.node != NO_NODE) folder.matchedSize = filterSums.of(*snapshot, folder.node);
+            }
         }
 
         // 2. DISPLAY
-        displayCurrentLevel(currentPath, folders);
+        if (revalidator) {
+            revalidator->show(currentPath, folders, filter.label);
+        } else {
+            renderer.show(makeViewModel(currentPath, folders, filter.label));
+        }
         
         // 3. INPUT
         std::string input;
         std::getline(std::cin, input);
+        // No redraws over the prompts below; numbers refer to the rows on screen
+        renderer.hold();
+        auto onScreen = renderer.drawn();
+        if (onScreen && onScreen->path == currentPath) {
+            folders = onScreen->rows;
+        }
         
         // Trim
         while (!input.empty() && isspace(input.front())) input.erase(input.begin());
@@ -363,6 +7243,12 @@ int main(int argc, char* argv[]) {
             if (!history.empty()) {
                 currentPath = history.back();
                 history.pop_back();
+            } else if (snapshot && currentPath != snapshot->rootPath &&
+                       findNode(*snapshot, currentPath.parent_path()) != NO_NODE) {
+                // Up within the snapshot (a cached one may start below its root)
+                currentPath = currentPath.parent_path();
+            } else if (snapshot && !revalidator) {
+                // Top of a saved snapshot: there is nothing above it
             } else {
                 // Return to drive selection if at root history
                 currentPath = selectDrive();
@@ -371,6 +7257,58 @@ int main(int argc, char* argv[]) {
         else if (input == "r" || input == "R") {
             // REFRESH (Clear cache for this folder)
             globalCache.erase(pathKey);
+            ownLeadersCache.erase(pathKey);
+            if (revalidator) revalidator->refresh(folders);
+        }
+        else if (input == "f" || input == "F") {
+            // FILTER (recomputed for the whole snapshot in one pass)
+            if (!snapshot) {
+                std::cout << "Filters need a snapshot (--snapshot FILE). Press Enter to continue...";
+                std::cin.get();
+                continue;
+            }
+            std::cout << "Filter (older DAYS | newer DAYS | uid N | larger SIZE | ext .EXT, empty = off): ";
+            std::string spec;
+            std::getline(std::cin, spec);
+            if (spec.find_first_not_of(" \t") == std::string::npos) {
+                filter = FileFilter();
+            } else if (parseFilter(spec, filter)) {
+                filterSums = filteredSums(*snapshot, filter);
+            } else {
+                std::cout << "Invalid filter. Press Enter to continue...";
+                std::cin.get();
+            }
+        }
+        else if (input == "g" || input == "G" || input.compare(0, 2, "g ") == 0) {
+            // GO TO (straight there; only the target gets scanned)
+            PathCompleter completer(snapshot.get(), !revalidator, globalCache);
+            std::string typed = input.size() > 2 ? input.substr(2) : "";
+            typed.erase(0, typed.find_first_not_of(" \t"));
+            fs::path target;
+            if (promptGoTo(completer, currentPath, typed, target) && target != currentPath) {
+                history.push_back(currentPath);
+                currentPath = target;
+            }
+        }
+        else if (input == "l" || input == "L") {
+            // OWN SIZE: folders below whose own files are largest, numbered for jumping
+            std::uint32_t node = snapshot ? findNode(*snapshot, currentPath) : NO_NODE;
+            OwnLeaders leaders = node != NO_NODE ? treeOwnLeaders(*snapshot, node) : ownLeadersCache[pathKey];
+            clearScreen();
+            printOwnLeaders(leaders, currentPath, true);
+            std::cout << "\n[num] = go there, Enter = back: ";
+            std::string choice;
+            std::getline(std::cin, choice);
+            std::vector<OwnUsage> rows = ownLeaderRows(leaders);
+            try {
+                std::size_t index = std::stoul(choice);
+                if (index < rows.size() && rows[index].path != currentPath) {
+                    history.push_back(currentPath);
+                    currentPath = rows[index].path;
+                }
+            } catch (...) {
+                // Back to the folder list
+            }
         }
         else if (input == "q" || input == "Q") {
             break;
@@ -395,5 +7333,9 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (!traceFile.empty() && !writeTraceFile(traceFile)) {
+        return 1;
+    }
+    
     return 0;
 }